@@ -14,65 +14,34 @@ static int next_batch_pid = 0;
 extern pthread_mutex_t shellmemory_lock;
 
 PCB *parseBatchScript() {
-    int program_size = 0;
-    char line[MAX_LINE_LENGTH];
-    int array_size = 2;
-    char **batch_script = malloc(sizeof(char *) * array_size);
+    // a batch script nested in another one gets what the outer one left of stdin, i.e. nothing
+    program_finish_stdin_spool();
 
-    // reading from stdin stream (the batch script file)
-    while (fgets(line, MAX_LINE_LENGTH, stdin) != NULL) {
-        batch_script[program_size] = strdup(line);
-        //printf("batch script line %i: %s\n", program_size, batch_script[program_size]);
-        program_size++;
-
-        // dynamically reallocating memory if needed
-        if (program_size >= array_size) {
-            array_size *= 2;
-            char **tmp = realloc(batch_script, sizeof(char *) * array_size);
-
-            if (tmp == NULL) {
-                free_array(batch_script, program_size);
-                printf("Couldn't reallocate memory for batch script\n");
-                return NULL;
-            }
-            batch_script = tmp;
-        }
-    }
-    Program *bg_executable = create_background_program(batch_script, program_size);
-
-    free_array(batch_script, program_size);
+    Program *bg_executable = create_background_program();
+    if (bg_executable == NULL) return NULL;
     PCB *pcb = pcb_create(bg_executable);
     pcb_toggle_background_mode(pcb);
     return pcb;
 }
 
-Program *create_background_program(char **background_script, int script_size) {
+Program *create_background_program() {
     char script_name[MAX_BACKGROUND_NAME_LENGTH];
     snprintf(script_name, sizeof(script_name), "BATCH%d", next_batch_pid);
     next_batch_pid++;
-    Program* background_program = program_create(script_name);
-
-    background_program_set_length(background_program, script_size);
-    int n_frames = convert_length_to_pages(script_size);
-    background_program_set_frames_idx(background_program, n_frames);
-    load_background_program_pages(background_program, background_script, n_frames);
+    Program* background_program = background_program_create(script_name);
+    if (background_program == NULL) return NULL;
+
+    // the rest of stdin is spooled as it gets executed, only the first pages are read up front
+    if (background_program_open_spool(background_program, stdin) ||
+        program_spool_lines(background_program, 2 * frame_size) ||
+        program_load_initial_pages(background_program)) {
+        printf("Couldn't spool batch script\n");
+        program_release(background_program);
+        return NULL;
+    }
     return background_program;
 }
 
-int load_background_program_pages(Program *bp, char** background_script, int n_pages) {
-    pthread_mutex_lock(&shellmemory_lock);
-    for (int i=0; i<n_pages; i++) {
-        int page_number = i;
-        int errorCode = load_page_into_frame_store(bp, background_script, page_number);
-        if (errorCode) {
-            pthread_mutex_unlock(&shellmemory_lock);
-            return 1;
-        } 
-    } 
-    pthread_mutex_unlock(&shellmemory_lock);
-    return 0;
-}
-
 int create_batch_script_pcb_and_enqueue() {
     PCB *batch_script_pcb = parseBatchScript();
 
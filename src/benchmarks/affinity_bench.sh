@@ -0,0 +1,84 @@
+#!/bin/bash
+# Compares worker placement in multithreaded mode: floating workers, workers pinned to CPUs, and pinned
+# workers that keep each PCB on the worker that last ran it, each on a set of CPU layouts.
+#
+# usage: benchmarks/affinity_bench.sh [policies...]   (run from src/ after make)
+# default policies: RR SJF
+#
+# A layout is a CPU list given to taskset, the workers are pinned inside it. NEAR defaults to two
+# neighbouring CPUs and FAR to the first and the middle one, which on a two-socket machine sit on
+# different nodes; with numactl and more than one node FAR also binds memory to the first node only,
+# so the second worker's frames are remote. On a single-CPU box every layout is that one CPU.
+# The workload is one exec of three long scripts, fed through a fifo so `stats` comes once every line
+# is printed. Reported: best wall time over RUNS, lines per second, and PCB migrations between workers.
+
+MYSH=${MYSH:-./mysh}
+LINES=${LINES:-2000}
+RUNS=${RUNS:-3}
+MYSH_ARGS=${MYSH_ARGS:---huge-page-order=6}
+POLICIES=${@:-RR SJF}
+cpus=$(nproc)
+NEAR=${NEAR:-0,$((1 % cpus))}
+FAR=${FAR:-0,$((cpus / 2))}
+
+if [ ! -x "$MYSH" ]; then
+    echo "Build the shell first (make), or point MYSH at it"
+    exit 1
+fi
+MYSH=$(realpath "$MYSH")
+
+FAR_MEMORY=""
+if command -v numactl > /dev/null && [ "$(numactl --hardware | awk '/^available:/ { print $2 }')" -gt 1 ]; then
+    FAR_MEMORY="numactl --membind=0"
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+for i in 1 2 3; do
+    for j in $(seq 1 $LINES); do echo "echo S${i}x$j"; done > "$WORK/long$i"
+done
+total_lines=$((3 * LINES))
+
+CONFIGS="floating: pinned:--pin-workers=1 sticky:--pin-workers=1,--sticky-workers=1"
+
+printf "%-8s %-6s %-10s %10s %12s %12s\n" "policy" "cpus" "placement" "ms" "lines/sec" "migrations"
+for policy in $POLICIES; do
+    for layout in NEAR FAR; do
+        cpu_list=${!layout}
+        prefix="taskset -c $cpu_list"
+        if [ $layout == FAR ] && [ -n "$FAR_MEMORY" ]; then prefix="$FAR_MEMORY $prefix"; fi
+        for config in $CONFIGS; do
+            name=${config%%:*}
+            flags=$(echo "${config#*:}" | tr ',' ' ')
+            best_ns=0
+            for run in $(seq 1 $RUNS); do
+                rm -f "$WORK/in" "$WORK/out.txt"
+                mkfifo "$WORK/in"
+                (cd "$WORK" && $prefix stdbuf -oL "$MYSH" --frame-store-size=$((total_lines * 2)) $MYSH_ARGS $flags < in > out.txt) &
+                pid=$!
+                exec 3> "$WORK/in"
+                start=$(date +%s%N)
+                echo "exec long1 long2 long3 $policy MT" >&3
+                while [ "$(grep -c '^S[0-9]*x' "$WORK/out.txt" 2>/dev/null)" -lt $total_lines ]; do
+                    if ! kill -0 $pid 2>/dev/null; then break; fi
+                    sleep 0.005
+                done
+                end=$(date +%s%N)
+                echo "stats" >&3  # once every line is out, so the migrations cover the whole run
+                echo "quit" >&3
+                exec 3>&-
+                wait $pid
+                elapsed=$((end - start))
+                if [ $best_ns == 0 ] || [ $elapsed -lt $best_ns ]; then best_ns=$elapsed; fi
+            done
+            if [ "$(grep -c '^S[0-9]*x' "$WORK/out.txt")" -ne $total_lines ]; then
+                echo "$policy $name: the shell didn't run the workload"
+                continue
+            fi
+            migrations=$(grep "^Workers:" "$WORK/out.txt" | awk '{ print $NF }')
+            throughput=$(awk -v lines=$total_lines -v ns=$best_ns 'BEGIN { printf "%.0f", lines / (ns / 1e9) }')
+            printf "%-8s %-6s %-10s %10s %12s %12s\n" "$policy" "$cpu_list" "$name" $((best_ns / 1000000)) "$throughput" "$migrations"
+        done
+    done
+done
@@ -0,0 +1,66 @@
+#!/bin/bash
+# Sweeps round robin quanta and reports throughput against response time.
+#
+# usage: benchmarks/rr_sweep.sh [quanta...]   (run from src/ after make)
+# default quanta: RR:1 RR:2 RR:4 RR:8 RR:16 RR:30 RR:64 RR:1ms RR:5ms RR:20ms
+#
+# The workload is long and short scripts exec'd together (exec takes at most three). Response time is how many
+# lines the shell printed before a script's first line, averaged over the scripts, so it doesn't
+# depend on the machine. Throughput is lines executed per second of wall time.
+
+MYSH=${MYSH:-./mysh}
+SHORT=${SHORT:-2}      # number of short scripts
+LONG=${LONG:-1}        # number of long scripts
+SHORT_LINES=${SHORT_LINES:-10}
+LONG_LINES=${LONG_LINES:-400}
+RUNS=${RUNS:-3}
+# a page fault ends a slice early, larger pages keep long scripts from faulting every third line
+MYSH_ARGS=${MYSH_ARGS:---huge-page-order=6}
+QUANTA=${@:-RR:1 RR:2 RR:4 RR:8 RR:16 RR:30 RR:64 RR:1ms RR:5ms RR:20ms}
+
+if [ ! -x "$MYSH" ]; then
+    echo "Build the shell first (make), or point MYSH at it"
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+scripts=""
+for i in $(seq 1 $LONG); do
+    for j in $(seq 1 $LONG_LINES); do echo "echo L${i}x$j"; done > "$WORK/long$i"
+    scripts="$scripts long$i"
+done
+for i in $(seq 1 $SHORT); do
+    for j in $(seq 1 $SHORT_LINES); do echo "echo S${i}x$j"; done > "$WORK/short$i"
+    scripts="$scripts short$i"
+done
+total_lines=$((LONG * LONG_LINES + SHORT * SHORT_LINES))
+
+printf "%-10s %14s %16s %16s\n" "quantum" "lines/sec" "avg response" "short done at"
+for quantum in $QUANTA; do
+    best_ns=0
+    for run in $(seq 1 $RUNS); do
+        start=$(date +%s%N)
+        (cd "$WORK" && echo "exec$scripts $quantum" | "$MYSH" --frame-store-size=$((total_lines * 2)) $MYSH_ARGS > out.txt)
+        end=$(date +%s%N)
+        elapsed=$((end - start))
+        if [ $best_ns == 0 ] || [ $elapsed -lt $best_ns ]; then best_ns=$elapsed; fi
+    done
+    if ! grep -q "^[LS][0-9]*x" "$WORK/out.txt"; then
+        echo "$quantum: the shell didn't run the workload"
+        head -3 "$WORK/out.txt"
+        continue
+    fi
+    # response: lines printed before each script's first line; short done: lines printed before the last short line
+    read response short_done < <(awk '
+        /^[LS][0-9]+x[0-9]+$/ {
+            split($0, id, "x")
+            if (!(id[1] in first)) { first[id[1]] = n; scripts++ ; sum += n }
+            if (substr($0, 1, 1) == "S") last_short = n
+            n++
+        }
+        END { printf "%.1f %d\n", (scripts ? sum / scripts : 0), last_short }' "$WORK/out.txt")
+    throughput=$(awk -v lines=$total_lines -v ns=$best_ns 'BEGIN { printf "%.0f", lines / (ns / 1e9) }')
+    printf "%-10s %14s %16s %16s\n" "$quantum" "$throughput" "$response" "$short_done"
+done
@@ -0,0 +1,57 @@
+#!/bin/bash
+# Measures how workers are woken in multithreaded mode: wake-to-run latency, wakeups that found
+# nothing to do, and the shell's context switches, per policy.
+#
+# usage: benchmarks/wake_bench.sh [policies...]   (run from src/ after make)
+# default policies: SJF AGING MLFQ FAIR RR
+#
+# The workload is ROUNDS exec commands of three short scripts each, PACE apart, so workers keep
+# going idle and being woken. The shell reads them from a fifo and gets `stats` once every line has been printed.
+
+MYSH=${MYSH:-./mysh}
+ROUNDS=${ROUNDS:-50}
+LINES=${LINES:-20}
+PACE=${PACE:-0.005}    # seconds between exec commands, long enough for the workers to go idle
+POLICIES=${@:-SJF AGING MLFQ FAIR RR}
+
+if [ ! -x "$MYSH" ]; then
+    echo "Build the shell first (make), or point MYSH at it"
+    exit 1
+fi
+MYSH=$(realpath "$MYSH")
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+for i in 1 2 3; do
+    for j in $(seq 1 $LINES); do echo "echo S${i}x$j"; done > "$WORK/short$i"
+done
+expected=$((ROUNDS * 3 * LINES))
+
+printf "%-8s %10s %10s %10s %14s %14s %12s %12s\n" "policy" "ms" "wakeups" "wasted" "avg wake us" "max wake us" "vol cs" "invol cs"
+for policy in $POLICIES; do
+    rm -f "$WORK/in" "$WORK/out.txt"
+    mkfifo "$WORK/in"
+    (cd "$WORK" && stdbuf -oL "$MYSH" < in > out.txt) &  # line buffered, so progress can be polled
+    pid=$!
+    exec 3> "$WORK/in"
+    start=$(date +%s%N)
+    for round in $(seq 1 $ROUNDS); do echo "exec short1 short2 short3 $policy MT" >&3; sleep $PACE; done
+    while [ "$(grep -c '^S[0-9]*x' "$WORK/out.txt" 2>/dev/null)" -lt $expected ]; do
+        if ! kill -0 $pid 2>/dev/null; then break; fi
+        sleep 0.01
+    done
+    end=$(date +%s%N)
+    echo "stats" >&3
+    echo "quit" >&3
+    exec 3>&-
+    wait $pid
+    line=$(grep "^Workers:" "$WORK/out.txt")
+    if [ -z "$line" ]; then
+        echo "$policy: the shell didn't report worker stats"
+        continue
+    fi
+    # Workers: wakeups N, wasted N, wake-to-run avg X us, max Y us, context switches A voluntary, B involuntary
+    read wakeups wasted avg max vol invol < <(echo "$line" | tr -d ',' | awk '{ print $3, $5, $8, $11, $15, $17 }')
+    printf "%-8s %10s %10s %10s %14s %14s %12s %12s\n" "$policy" $(((end - start) / 1000000)) "$wakeups" "$wasted" "$avg" "$max" "$vol" "$invol"
+done
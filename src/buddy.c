@@ -0,0 +1,116 @@
+#include "buddy.h"
+#include "config.h"
+#include <stdlib.h>
+
+// Buddy allocator over frame numbers. A block of order k is 2^k contiguous frames starting at a
+// multiple of 2^k, its buddy is the block it was split from the other half of.
+
+static int *block_order;  // order of the block starting at a frame, -1 inside a block
+static char *block_free;
+static int *free_next;    // free blocks of each order, doubly linked through their first frame
+static int *free_prev;
+static int free_head[MAX_PAGE_ORDER + 1];
+static int total_frames = 0;
+
+static void push_free(int frame, int order) {
+    block_order[frame] = order;
+    block_free[frame] = 1;
+    free_prev[frame] = -1;
+    free_next[frame] = free_head[order];
+    if (free_head[order] != -1) free_prev[free_head[order]] = frame;
+    free_head[order] = frame;
+}
+
+static void unlink_free(int frame) {
+    int order = block_order[frame];
+    if (free_prev[frame] != -1) free_next[free_prev[frame]] = free_next[frame];
+    else free_head[order] = free_next[frame];
+    if (free_next[frame] != -1) free_prev[free_next[frame]] = free_prev[frame];
+    block_free[frame] = 0;
+}
+
+// Frees a block and merges it with its buddy for as long as the buddy is free and whole
+static void release_block(int frame, int order) {
+    while (order < MAX_PAGE_ORDER) {
+        int buddy = frame ^ (1 << order);
+        if (buddy + (1 << order) > total_frames || !block_free[buddy] || block_order[buddy] != order) break;
+        unlink_free(buddy);
+        block_order[buddy] = -1;
+        block_order[frame] = -1;
+        if (buddy < frame) frame = buddy;
+        order++;
+    }
+    push_free(frame, order);
+}
+
+int buddy_grow(int num_of_frames) {
+    if (num_of_frames <= total_frames) return 0;
+    int *new_order = realloc(block_order, sizeof(int) * num_of_frames);
+    if (new_order == NULL) return 1;
+    block_order = new_order;
+    char *new_free = realloc(block_free, num_of_frames);
+    if (new_free == NULL) return 1;
+    block_free = new_free;
+    int *new_next = realloc(free_next, sizeof(int) * num_of_frames);
+    if (new_next == NULL) return 1;
+    free_next = new_next;
+    int *new_prev = realloc(free_prev, sizeof(int) * num_of_frames);
+    if (new_prev == NULL) return 1;
+    free_prev = new_prev;
+
+    int frame = total_frames;
+    for (int i = frame; i < num_of_frames; i++) {
+        block_order[i] = -1;
+        block_free[i] = 0;
+    }
+    total_frames = num_of_frames;
+    while (frame < num_of_frames) {  // carve the new frames into the largest aligned blocks that fit
+        int order = 0;
+        while (order < MAX_PAGE_ORDER && frame % (2 << order) == 0 && frame + (2 << order) <= num_of_frames) {
+            order++;
+        }
+        release_block(frame, order);
+        frame += 1 << order;
+    }
+    return 0;
+}
+
+int buddy_init(int num_of_frames) {
+    for (int i = 0; i <= MAX_PAGE_ORDER; i++) free_head[i] = -1;
+    return buddy_grow(num_of_frames);
+}
+
+int buddy_alloc(int order) {
+    int found = order;
+    while (found <= MAX_PAGE_ORDER && free_head[found] == -1) found++;
+    if (found > MAX_PAGE_ORDER) return -1;
+
+    int frame = free_head[found];
+    unlink_free(frame);
+    while (found > order) {  // split, keeping the lower half
+        found--;
+        push_free(frame + (1 << found), found);
+    }
+    block_order[frame] = order;
+    return frame;
+}
+
+int buddy_free(int frame_number) {
+    if (frame_number < 0 || frame_number >= total_frames || block_free[frame_number] || block_order[frame_number] == -1) {
+        return 1;
+    }
+    release_block(frame_number, block_order[frame_number]);
+    return 0;
+}
+
+// Order of the allocated block starting at frame_number, -1 if none starts there
+int buddy_block_order(int frame_number) {
+    if (frame_number < 0 || frame_number >= total_frames || block_free[frame_number]) return -1;
+    return block_order[frame_number];
+}
+
+int buddy_max_order() {
+    int order = 0;
+    while (order < MAX_PAGE_ORDER && (2 << order) <= total_frames) order++;
+    return order;
+}
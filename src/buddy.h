@@ -0,0 +1,9 @@
+#ifndef BUDDY_H
+#define BUDDY_H
+int buddy_init(int num_of_frames);
+int buddy_grow(int num_of_frames);
+int buddy_alloc(int order);
+int buddy_free(int frame_number);
+int buddy_block_order(int frame_number);
+int buddy_max_order();
+#endif
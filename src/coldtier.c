@@ -0,0 +1,292 @@
+#include "coldtier.h"
+#include "config.h"
+#include "program.h"
+#include "shellmemory.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+// Evicted pages are compressed into a byte-budgeted tier so a fault on them doesn't need the
+// program's image, which may have been dropped from the cache, or the script on disk.
+
+#define COLD_TIER_BUCKETS 1024
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+
+extern pthread_mutex_t shellmemory_lock;
+
+typedef struct ColdPage {
+    Program *program;
+    int page_number;
+    int raw_length;
+    int compressed_length;
+    unsigned char *data;
+    struct ColdPage *hash_next;
+    struct ColdPage *older;  // age list, the oldest page is dropped first when over budget
+    struct ColdPage *newer;
+} ColdPage;
+
+static ColdPage *buckets[COLD_TIER_BUCKETS];
+static ColdPage *oldest = NULL;
+static ColdPage *newest = NULL;
+static size_t tier_bytes = 0;
+static int tier_pages = 0;
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+static unsigned long stores = 0;
+static unsigned long rejected = 0;
+static unsigned long dropped = 0;
+static size_t raw_bytes_stored = 0;
+static size_t compressed_bytes_stored = 0;
+
+// LZ4-style block coding: each sequence is a token (literal count, match length - 4), the
+// literals, then a 2-byte offset back to the match. Counts of 15 or more continue in extra bytes.
+
+static int lz_put_count(unsigned char *dst, int pos, int cap, int count) {
+    while (count >= 255) {
+        if (pos >= cap) return -1;
+        dst[pos++] = 255;
+        count -= 255;
+    }
+    if (pos >= cap) return -1;
+    dst[pos++] = count;
+    return pos;
+}
+
+static int lz_put_sequence(unsigned char *dst, int pos, int cap, const unsigned char *literals, int n_literals, int offset, int match_length) {
+    if (pos >= cap) return -1;
+    int token_pos = pos++;
+    int match_code = (match_length == 0) ? 0 : match_length - LZ_MIN_MATCH;
+    dst[token_pos] = ((n_literals < 15 ? n_literals : 15) << 4) | (match_code < 15 ? match_code : 15);
+    if (n_literals >= 15 && (pos = lz_put_count(dst, pos, cap, n_literals - 15)) == -1) return -1;
+    if (pos + n_literals > cap) return -1;
+    memcpy(dst + pos, literals, n_literals);
+    pos += n_literals;
+    if (match_length == 0) return pos;  // last sequence, literals only
+    if (pos + 2 > cap) return -1;
+    dst[pos++] = offset & 0xff;
+    dst[pos++] = offset >> 8;
+    if (match_code >= 15 && (pos = lz_put_count(dst, pos, cap, match_code - 15)) == -1) return -1;
+    return pos;
+}
+
+static uint32_t lz_read32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static int lz_compress(const unsigned char *src, int src_length, unsigned char *dst, int cap) {
+    int table[1 << LZ_HASH_BITS];
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) table[i] = -1;
+    int anchor = 0;
+    int pos = 0;
+    int i = 0;
+    while (i + LZ_MIN_MATCH <= src_length) {
+        uint32_t sequence = lz_read32(src + i);
+        int h = (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+        int candidate = table[h];
+        table[h] = i;
+        if (candidate == -1 || i - candidate > 65535 || lz_read32(src + candidate) != sequence) {
+            i++;
+            continue;
+        }
+        int match_length = LZ_MIN_MATCH;
+        while (i + match_length < src_length && src[candidate + match_length] == src[i + match_length]) match_length++;
+        pos = lz_put_sequence(dst, pos, cap, src + anchor, i - anchor, i - candidate, match_length);
+        if (pos == -1) return -1;
+        i += match_length;
+        anchor = i;
+    }
+    return lz_put_sequence(dst, pos, cap, src + anchor, src_length - anchor, 0, 0);
+}
+
+static int lz_get_count(const unsigned char *src, int *pos, int length, int count) {
+    if (count != 15) return count;
+    unsigned char byte;
+    do {
+        if (*pos >= length) return -1;
+        byte = src[(*pos)++];
+        count += byte;
+    } while (byte == 255);
+    return count;
+}
+
+static int lz_decompress(const unsigned char *src, int src_length, unsigned char *dst, int dst_length) {
+    int pos = 0;
+    int out = 0;
+    while (pos < src_length) {
+        int token = src[pos++];
+        int n_literals = lz_get_count(src, &pos, src_length, token >> 4);
+        if (n_literals == -1 || pos + n_literals > src_length || out + n_literals > dst_length) return -1;
+        memcpy(dst + out, src + pos, n_literals);
+        pos += n_literals;
+        out += n_literals;
+        if (pos == src_length) break;
+        if (pos + 2 > src_length) return -1;
+        int offset = src[pos] | (src[pos + 1] << 8);
+        pos += 2;
+        int match_length = lz_get_count(src, &pos, src_length, token & 15);
+        if (match_length == -1 || offset == 0 || offset > out) return -1;
+        match_length += LZ_MIN_MATCH;
+        if (out + match_length > dst_length) return -1;
+        for (int i = 0; i < match_length; i++, out++) dst[out] = dst[out - offset];  // matches may overlap
+    }
+    return out;
+}
+
+static unsigned long bucket_of(Program *p, int page_number) {
+    return (((uintptr_t)p >> 4) * 31 + page_number) % COLD_TIER_BUCKETS;
+}
+
+static ColdPage *find_page(Program *p, int page_number) {
+    for (ColdPage *curr = buckets[bucket_of(p, page_number)]; curr != NULL; curr = curr->hash_next) {
+        if (curr->program == p && curr->page_number == page_number) return curr;
+    }
+    return NULL;
+}
+
+static void remove_page(ColdPage *page) {
+    for (ColdPage **curr = &buckets[bucket_of(page->program, page->page_number)]; *curr != NULL; curr = &(*curr)->hash_next) {
+        if (*curr == page) {
+            *curr = page->hash_next;
+            break;
+        }
+    }
+    if (page->older != NULL) page->older->newer = page->newer;
+    else oldest = page->newer;
+    if (page->newer != NULL) page->newer->older = page->older;
+    else newest = page->older;
+    tier_bytes -= sizeof(ColdPage) + page->compressed_length;
+    tier_pages--;
+    program_add_cold_pages(page->program, -1);
+    free(page->data);
+    free(page);
+}
+
+int cold_tier_store(Program *p, int page_number, int frame_number) {
+    if (cold_tier_size <= 0) return 1;
+    int page_size = program_get_page_size(p);
+    int raw_length = 0;
+    for (int i = 0; i < page_size; i++) {
+        const char *line = frame_store_line(frame_number * frame_size + i);
+        if (line == NULL) break;
+        raw_length += strlen(line) + 1;
+    }
+    unsigned char *raw = malloc(raw_length + 1);
+    if (raw == NULL) return 1;
+    int raw_pos = 0;
+    for (int i = 0; i < page_size; i++) {  // lines are kept '\0' separated
+        const char *line = frame_store_line(frame_number * frame_size + i);
+        if (line == NULL) break;
+        size_t line_length = strlen(line) + 1;
+        memcpy(raw + raw_pos, line, line_length);
+        raw_pos += line_length;
+    }
+    int cap = raw_length + raw_length / 255 + 16;
+    unsigned char *compressed = malloc(cap);
+    int compressed_length = (compressed == NULL) ? -1 : lz_compress(raw, raw_length, compressed, cap);
+    free(raw);
+    if (compressed_length == -1 || (long)(sizeof(ColdPage) + compressed_length) > cold_tier_size) {
+        free(compressed);
+        rejected++;
+        return 1;
+    }
+
+    ColdPage *old = find_page(p, page_number);
+    if (old != NULL) remove_page(old);
+    ColdPage *page = malloc(sizeof(ColdPage));
+    if (page == NULL) {
+        free(compressed);
+        return 1;
+    }
+    page->program = p;
+    page->page_number = page_number;
+    page->raw_length = raw_length;
+    page->compressed_length = compressed_length;
+    unsigned char *shrunk = realloc(compressed, compressed_length > 0 ? compressed_length : 1);
+    page->data = (shrunk != NULL) ? shrunk : compressed;
+    unsigned long bucket = bucket_of(p, page_number);
+    page->hash_next = buckets[bucket];
+    buckets[bucket] = page;
+    page->newer = NULL;
+    page->older = newest;
+    if (newest != NULL) newest->newer = page;
+    else oldest = page;
+    newest = page;
+    tier_bytes += sizeof(ColdPage) + compressed_length;
+    tier_pages++;
+    program_add_cold_pages(p, 1);
+    stores++;
+    raw_bytes_stored += raw_length;
+    compressed_bytes_stored += compressed_length;
+    return 0;
+}
+
+// Drops the oldest pages until the tier is back under budget. A finished program whose last cold
+// page goes is collected right away, so the caller must not hold on to any finished program.
+void cold_tier_trim() {
+    while (tier_bytes > (size_t)cold_tier_size && oldest != NULL) {
+        Program *p = oldest->program;
+        remove_page(oldest);
+        dropped++;
+        if (program_get_cold_pages(p) == 0) program_reclaim_if_empty(p);
+    }
+}
+
+int cold_tier_contains(Program *p, int page_number) {
+    return cold_tier_size > 0 && find_page(p, page_number) != NULL;
+}
+
+// Decompresses the page into the frame and takes it out of the tier, returns 1 if it isn't there
+int cold_tier_load(Program *p, int page_number, int frame_number) {
+    if (cold_tier_size <= 0) return 1;
+    ColdPage *page = find_page(p, page_number);
+    if (page == NULL) {
+        misses++;
+        return 1;
+    }
+    unsigned char *raw = malloc(page->raw_length + 1);
+    if (raw == NULL || lz_decompress(page->data, page->compressed_length, raw, page->raw_length) != page->raw_length) {
+        free(raw);
+        remove_page(page);
+        misses++;
+        return 1;
+    }
+    int idx = frame_number * frame_size;
+    for (int pos = 0; pos < page->raw_length; idx++) {
+        prog_write_line(idx, (const char *)raw + pos);
+        pos += strlen((const char *)raw + pos) + 1;
+    }
+    free(raw);
+    remove_page(page);
+    hits++;
+    return 0;
+}
+
+void cold_tier_forget(Program *p, int page_number) {
+    if (cold_tier_size <= 0) return;
+    ColdPage *page = find_page(p, page_number);
+    if (page != NULL) remove_page(page);
+}
+
+void cold_tier_drop_program(Program *p) {
+    ColdPage *curr = oldest;
+    while (curr != NULL && program_get_cold_pages(p) > 0) {
+        ColdPage *newer = curr->newer;
+        if (curr->program == p) remove_page(curr);
+        curr = newer;
+    }
+}
+
+void cold_tier_print_stats() {
+    if (cold_tier_size <= 0) return;
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
+    double ratio = (compressed_bytes_stored == 0) ? 0.0 : (double)raw_bytes_stored / compressed_bytes_stored;
+    printf("Cold tier: %d pages, %zu/%ld bytes, hits %lu, misses %lu, stored %lu, rejected %lu, dropped %lu, ratio %.2f\n",
+           tier_pages, tier_bytes, cold_tier_size, hits, misses, stores, rejected, dropped, ratio);
+    pthread_mutex_unlock(&shellmemory_lock);
+}
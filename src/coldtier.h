@@ -0,0 +1,11 @@
+#ifndef COLDTIER_H
+#define COLDTIER_H
+typedef struct Program Program;
+int cold_tier_store(Program *p, int page_number, int frame_number);
+void cold_tier_trim();
+int cold_tier_contains(Program *p, int page_number);
+int cold_tier_load(Program *p, int page_number, int frame_number);
+void cold_tier_forget(Program *p, int page_number);
+void cold_tier_drop_program(Program *p);
+void cold_tier_print_stats();
+#endif
@@ -0,0 +1,167 @@
+#include "config.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int mem_size = MEM_SIZE;
+int frame_store_size = FRAME_STORE_SIZE;
+int frame_store_max_size = FRAME_STORE_MAX_SIZE;
+int frame_size = FRAME_SIZE;
+int huge_page_order = HUGE_PAGE_ORDER;
+int dedup_pages = DEDUP_PAGES;
+int reclaim_first = RECLAIM_FIRST;
+long program_cache_size = PROGRAM_CACHE_SIZE;
+long cold_tier_size = COLD_TIER_SIZE;
+int coroutines = COROUTINES;
+int pin_workers = PIN_WORKERS;
+int sticky_workers = STICKY_WORKERS;
+int event_loop = EVENT_LOOP;
+int stats_on_exit = STATS_ON_EXIT;
+const char *cache_dir = NULL;
+const char *trace_file = NULL;
+
+// The numeric settings as parsed, checked together before any of them takes effect
+typedef struct Config {
+    long mem_size;
+    long frame_store_size;
+    long frame_store_max_size;
+    long frame_size;
+    long reclaim_first;
+    long program_cache_size;
+    long huge_page_order;
+    long dedup_pages;
+    long cold_tier_size;
+    long coroutines;
+    long pin_workers;
+    long sticky_workers;
+    long event_loop;
+    long stats_on_exit;
+} Config;
+
+typedef struct Option {
+    const char *flag;
+    const char *env;
+    long *value;
+    long min;
+} Option;
+
+typedef struct StringOption {
+    const char *flag;
+    const char *env;
+    const char **value;  // empty turns the feature off
+} StringOption;
+
+static int flag_matches(const char *argument, size_t flag_length, const char *flag) {
+    return strlen(flag) == flag_length && strncmp(argument, flag, flag_length) == 0;
+}
+
+static int parse_number(const char *name, const char *string, long min, long *value) {
+    char *end;
+    long number = strtol(string, &end, 10);
+    if (string[0] == '\0' || *end != '\0' || number < min || number > INT_MAX) {
+        printf("Invalid value for %s: %s\n", name, string);
+        return 1;
+    }
+    *value = number;
+    return 0;
+}
+
+// Settings come from the compile-time defaults, then MYSH_* environment variables, then --flag=value arguments
+int config_init(int argc, char *argv[]) {
+    Config config = {
+        .mem_size = mem_size,
+        .frame_store_size = frame_store_size,
+        .frame_store_max_size = frame_store_max_size,
+        .frame_size = frame_size,
+        .reclaim_first = reclaim_first,
+        .program_cache_size = program_cache_size,
+        .huge_page_order = huge_page_order,
+        .dedup_pages = dedup_pages,
+        .cold_tier_size = cold_tier_size,
+        .coroutines = coroutines,
+        .pin_workers = pin_workers,
+        .sticky_workers = sticky_workers,
+        .event_loop = event_loop,
+        .stats_on_exit = stats_on_exit,
+    };
+    Option options[] = {
+        {"--var-store-size", "MYSH_VAR_STORE_SIZE", &config.mem_size, 1},
+        {"--frame-store-size", "MYSH_FRAME_STORE_SIZE", &config.frame_store_size, 1},
+        {"--frame-store-max-size", "MYSH_FRAME_STORE_MAX_SIZE", &config.frame_store_max_size, 0},
+        {"--frame-size", "MYSH_FRAME_SIZE", &config.frame_size, 1},
+        {"--reclaim-first", "MYSH_RECLAIM_FIRST", &config.reclaim_first, 0},
+        {"--cache-size", "MYSH_CACHE_SIZE", &config.program_cache_size, 0},
+        {"--huge-page-order", "MYSH_HUGE_PAGE_ORDER", &config.huge_page_order, 0},
+        {"--dedup-pages", "MYSH_DEDUP_PAGES", &config.dedup_pages, 0},
+        {"--cold-tier-size", "MYSH_COLD_TIER_SIZE", &config.cold_tier_size, 0},
+        {"--coroutines", "MYSH_COROUTINES", &config.coroutines, 0},
+        {"--pin-workers", "MYSH_PIN_WORKERS", &config.pin_workers, 0},
+        {"--sticky-workers", "MYSH_STICKY_WORKERS", &config.sticky_workers, 0},
+        {"--event-loop", "MYSH_EVENT_LOOP", &config.event_loop, 0},
+        {"--stats-on-exit", "MYSH_STATS_ON_EXIT", &config.stats_on_exit, 0},
+    };
+    int n_options = sizeof(options) / sizeof(options[0]);
+    StringOption string_options[] = {
+        {"--cache-dir", "MYSH_CACHE_DIR", &cache_dir},
+        {"--trace-file", "MYSH_TRACE_FILE", &trace_file},
+    };
+    int n_string_options = sizeof(string_options) / sizeof(string_options[0]);
+
+    for (int i = 0; i < n_options; i++) {
+        const char *env_value = getenv(options[i].env);
+        if (env_value != NULL && parse_number(options[i].env, env_value, options[i].min, options[i].value)) return 1;
+    }
+    for (int i = 0; i < n_string_options; i++) {
+        *string_options[i].value = getenv(string_options[i].env);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = strchr(argv[i], '=');
+        size_t flag_length = (value == NULL) ? strlen(argv[i]) : (size_t)(value - argv[i]);
+        int k;
+        for (k = 0; k < n_string_options; k++) {
+            if (value != NULL && flag_matches(argv[i], flag_length, string_options[k].flag)) break;
+        }
+        if (k < n_string_options) {
+            *string_options[k].value = value + 1;
+            continue;
+        }
+        int j;
+        for (j = 0; j < n_options; j++) {
+            if (value != NULL && flag_matches(argv[i], flag_length, options[j].flag)) break;
+        }
+        if (j == n_options) {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+        if (parse_number(options[j].flag, value + 1, options[j].min, options[j].value)) return 1;
+    }
+
+    if (config.frame_store_size < config.frame_size) {
+        printf("Frame store size (%ld) must hold at least one frame of %ld lines\n", config.frame_store_size, config.frame_size);
+        return 1;
+    }
+    if (config.huge_page_order > MAX_PAGE_ORDER) {
+        printf("Huge page order (%ld) can't be above %d\n", config.huge_page_order, MAX_PAGE_ORDER);
+        return 1;
+    }
+    mem_size = config.mem_size;
+    frame_store_size = config.frame_store_size;
+    frame_store_max_size = (config.frame_store_max_size < config.frame_store_size) ? config.frame_store_size : config.frame_store_max_size;
+    frame_size = config.frame_size;
+    reclaim_first = config.reclaim_first;
+    program_cache_size = config.program_cache_size;
+    huge_page_order = config.huge_page_order;
+    dedup_pages = config.dedup_pages;
+    cold_tier_size = config.cold_tier_size;
+    coroutines = config.coroutines;
+    pin_workers = config.pin_workers;
+    sticky_workers = config.sticky_workers;
+    event_loop = config.event_loop;
+    stats_on_exit = config.stats_on_exit;
+    for (int i = 0; i < n_string_options; i++) {
+        if (*string_options[i].value != NULL && (*string_options[i].value)[0] == '\0') *string_options[i].value = NULL;
+    }
+    return 0;
+}
@@ -1,6 +1,7 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// compile-time defaults, each one can be overridden at startup (see config.c)
 #ifndef MEM_SIZE
 #define MEM_SIZE 1000
 #endif
@@ -9,8 +10,90 @@
 #define FRAME_STORE_SIZE 900
 #endif
 
+#ifndef FRAME_STORE_MAX_SIZE
+#define FRAME_STORE_MAX_SIZE 0  // 0 pins the frame store at its initial size
+#endif
+
+#ifndef FRAME_SIZE
+#define FRAME_SIZE 3
+#endif
+
+#ifndef HUGE_PAGE_ORDER
+#define HUGE_PAGE_ORDER 0  // largest page a long script may get is 2^HUGE_PAGE_ORDER frames, 0 keeps every page one frame
+#endif
+
+#ifndef DEDUP_PAGES
+#define DEDUP_PAGES 0  // share one frame between identical pages of different programs
+#endif
+
+#ifndef RECLAIM_FIRST
+#define RECLAIM_FIRST 0  // evict pages of finished programs before falling back to LRU
+#endif
+
+#ifndef PROGRAM_CACHE_SIZE
+#define PROGRAM_CACHE_SIZE 1048576  // bytes of script images kept for finished programs
+#endif
+
+#ifndef COLD_TIER_SIZE
+#define COLD_TIER_SIZE 0  // bytes of compressed evicted pages kept in memory, 0 disables the tier
+#endif
+
+#ifndef COROUTINES
+#define COROUTINES 0  // run PCB slices on coroutines in multithreaded mode, so a run child suspends the PCB instead of blocking a worker
+#endif
+
+#ifndef PIN_WORKERS
+#define PIN_WORKERS 0  // pin multithreaded worker i to the i-th CPU the shell may run on (see taskset)
+#endif
+
+#ifndef STICKY_WORKERS
+#define STICKY_WORKERS 0  // keep a PCB on the worker that last ran it while the policy allows
+#endif
+
+#ifndef EVENT_LOOP
+#define EVENT_LOOP 0  // at an interactive prompt, exec returns at once and its scripts run while the shell waits for input
+#endif
+
+#ifndef STATS_ON_EXIT
+#define STATS_ON_EXIT 0  // print every finished PCB's times (stats processes) when the shell exits
+#endif
+
+#define MAX_PAGE_ORDER 10
+#define MLFQ_LEVELS 3
+#define MLFQ_BASE_QUANTUM 2  // top level slice, doubled at each level below
+#define MLFQ_BOOST_PERIOD 120  // instructions between priority boosts
+#define RR_CLOCK_CHECK_INTERVAL 4  // instructions between clock reads under a time quantum
+#define FAIR_BASE_SLICE 2  // slice of a nice 0 PCB, scaled by weight for others
+#define EDF_SLICE 2  // instructions between deadline checks, so a script exec'd with an earlier deadline preempts
+#define HUGE_PAGE_MIN_PAGES 4
+#define MT_RING_SIZE 1024  // PCBs the FCFS/RR ring holds in multithreaded mode, more wait in the ready queue
+#define EPOCH_MAX_THREADS 64  // threads that can read the program table without a lock at once
+#define COROUTINE_STACK_SIZE 262144  // bytes, mapped lazily, only PCBs suspended mid-instruction hold one
+#define TRACE_RING_SIZE 4096  // events a thread can have waiting for the flusher before new ones are dropped
+#define TRACE_FLUSH_MS 20
+#define TRACE_NAME_LENGTH 32
+#define LOADER_THREADS 4  // threads reading script images in parallel during exec, the caller included
 #define MAX_LINE_LENGTH 100
-#define MAX_PROGRAM 100
 #define MAX_BACKGROUND_NAME_LENGTH 32
-#define FRAME_SIZE 3
-#endif
\ No newline at end of file
+#define SPOOL_RESERVE (1UL << 30)  // address space reserved for a spooled batch script
+#define SPOOL_CHUNK 65536
+
+extern int mem_size;
+extern int frame_store_size;      // current size in lines, can grow up to frame_store_max_size
+extern int frame_store_max_size;
+extern int frame_size;            // lines per frame, the smallest page
+extern int huge_page_order;
+extern int dedup_pages;
+extern int reclaim_first;
+extern long program_cache_size;
+extern long cold_tier_size;
+extern int coroutines;
+extern int pin_workers;
+extern int sticky_workers;
+extern int event_loop;
+extern int stats_on_exit;
+extern const char *cache_dir;     // on-disk image cache, NULL when disabled
+extern const char *trace_file;    // Chrome trace written here (trace.c), NULL when disabled
+
+int config_init(int argc, char *argv[]);
+#endif
@@ -0,0 +1,119 @@
+#include "coroutine.h"
+#include "config.h"
+#include "scheduler.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "trace.h"
+
+extern pthread_mutex_t interpreter_lock;
+
+// In multithreaded mode a worker can run each slice on a coroutine stack instead of its own, so a
+// command that has to wait for a child (run) suspends the PCB mid-instruction and the worker goes
+// on with other PCBs. Only a suspended PCB keeps its coroutine, the others hand it back to the pool
+// when their slice ends, so a PCB that isn't waiting costs no stack.
+// A suspended coroutine may resume on another worker, nothing on its stack keeps thread-local
+// state across the switch.
+
+typedef struct Coroutine {
+    ucontext_t context;
+    ucontext_t *caller;  // the worker context to switch back to at the end of the slice or to suspend
+    PCB *pcb;
+    ReadyQueue *queue;
+    Policy *policy;
+    int result;   // exec_program's result for the slice
+    int blocked;  // set when the coroutine suspended instead of finishing its slice
+    pid_t wait_pid;
+    struct Coroutine *next_free;
+} Coroutine;
+
+static Coroutine *free_coroutines = NULL;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread Coroutine *current = NULL;  // NULL while the thread runs on its own stack
+
+static void coroutine_main() {
+    Coroutine *co = current;
+    while (1) {  // one slice each time a worker switches in, then the coroutine goes back to the pool
+        co->result = exec_program(co->pcb, co->queue, co->policy);
+        swapcontext(&co->context, co->caller);
+    }
+}
+
+static Coroutine *coroutine_get() {
+    pthread_mutex_lock(&pool_lock);
+    Coroutine *co = free_coroutines;
+    if (co != NULL) free_coroutines = co->next_free;
+    pthread_mutex_unlock(&pool_lock);
+    if (co != NULL) return co;
+
+    co = malloc(sizeof(Coroutine));
+    if (co == NULL) return NULL;
+    long page_size = sysconf(_SC_PAGESIZE);
+    char *stack = mmap(NULL, COROUTINE_STACK_SIZE + page_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        free(co);
+        return NULL;
+    }
+    mprotect(stack, page_size, PROT_NONE);  // guard page, an overflow faults instead of writing past the stack
+    getcontext(&co->context);
+    co->context.uc_stack.ss_sp = stack + page_size;
+    co->context.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+    co->context.uc_link = NULL;
+    makecontext(&co->context, coroutine_main, 0);
+    return co;
+}
+
+static void coroutine_put(Coroutine *co) {  // the stack stays mapped, the pool only grows to the most PCBs ever suspended
+    pthread_mutex_lock(&pool_lock);
+    co->next_free = free_coroutines;
+    free_coroutines = co;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Runs one slice of pcb, or resumes it where it suspended. COROUTINE_BLOCKED means the PCB is
+// waiting for the child coroutine_get_wait_pid returns, the caller requeues it once the child exits.
+int coroutine_run_slice(PCB *pcb, ReadyQueue *queue, Policy *policy) {
+    Coroutine *co = pcb_get_coroutine(pcb);
+    if (co == NULL) {
+        co = coroutine_get();
+        if (co == NULL) return exec_program(pcb, queue, policy);  // the slice just can't suspend
+        co->pcb = pcb;
+        co->queue = queue;
+        co->policy = policy;
+    }
+    ucontext_t worker_context;
+    co->caller = &worker_context;
+    co->blocked = 0;
+    current = co;
+    swapcontext(&worker_context, &co->context);
+    current = NULL;
+
+    if (co->blocked) {
+        pcb_set_coroutine(pcb, co);
+        return COROUTINE_BLOCKED;
+    }
+    pcb_set_coroutine(pcb, NULL);
+    int result = co->result;
+    coroutine_put(co);
+    return result;
+}
+
+pid_t coroutine_get_wait_pid(PCB *pcb) {
+    return pcb_get_coroutine(pcb)->wait_pid;
+}
+
+// Suspends the running PCB until its worker's caller has reaped pid. 1 when not on a coroutine,
+// the caller then waits for the child itself.
+int coroutine_wait_child(pid_t pid) {
+    Coroutine *co = current;
+    if (co == NULL) return 1;
+    co->wait_pid = pid;
+    co->blocked = 1;
+    pthread_mutex_unlock(&interpreter_lock);  // taken by exec_program around the command, other PCBs go on meanwhile
+    swapcontext(&co->context, co->caller);
+    trace_lock(&interpreter_lock, "interpreter_lock");
+    return 0;
+}
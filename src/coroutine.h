@@ -0,0 +1,14 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+#include <sys/types.h>
+#include "pcb.h"
+
+#define COROUTINE_BLOCKED -1  // coroutine_run_slice's result when the PCB suspended mid-instruction
+
+typedef struct ReadyQueue ReadyQueue;
+typedef struct Policy Policy;
+
+int coroutine_run_slice(PCB *pcb, ReadyQueue *queue, Policy *policy);
+pid_t coroutine_get_wait_pid(PCB *pcb);
+int coroutine_wait_child(pid_t pid);
+#endif
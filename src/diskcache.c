@@ -0,0 +1,142 @@
+#include "diskcache.h"
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DISK_CACHE_MAGIC "MYSHIMG1"
+
+// On-disk layout: DiskImageHeader, then line_count + 1 int offsets, then the script text.
+// An entry is valid as long as the script still has the dev/inode/size/mtime recorded here.
+typedef struct DiskImageHeader {
+    char magic[8];
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t content_hash;  // FNV-1a of the text
+    uint32_t line_count;
+    uint32_t text_length;
+} DiskImageHeader;
+
+static int cache_dir_checked = 0;
+
+int disk_cache_enabled() {
+    if (!cache_dir_checked) {
+        if (cache_dir != NULL && mkdir(cache_dir, 0755) != 0 && errno != EEXIST) cache_dir = NULL;
+        cache_dir_checked = 1;
+    }
+    return cache_dir != NULL;
+}
+
+static void cache_entry_path(const struct stat *st, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s/%llx-%llx.img", cache_dir, (unsigned long long)st->st_dev, (unsigned long long)st->st_ino);
+}
+
+static uint64_t hash_text(const char *text, size_t text_length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < text_length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int header_matches(const DiskImageHeader *header, const struct stat *st) {
+    return memcmp(header->magic, DISK_CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+           header->dev == (uint64_t)st->st_dev && header->ino == (uint64_t)st->st_ino &&
+           header->size == (int64_t)st->st_size && header->mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+           header->mtime_nsec == (int64_t)st->st_mtim.tv_nsec;
+}
+
+// Entries are shared with other shells and may be stale or corrupt even when the header matches,
+// nothing in a mapping is trusted until the offsets stay inside the text and the hash checks out
+static int entry_valid(const DiskImageHeader *header, const int *line_offsets, const char *text) {
+    if (header->line_count > INT_MAX || header->text_length > INT_MAX) return 0;
+    int previous = 0;
+    for (uint32_t i = 0; i <= header->line_count; i++) {
+        if (line_offsets[i] < previous || (uint32_t)line_offsets[i] > header->text_length) return 0;
+        previous = line_offsets[i];
+    }
+    return text[header->text_length] == '\0' && hash_text(text, header->text_length) == header->content_hash;
+}
+
+int disk_cache_map(const struct stat *st, DiskImage *image) {
+    if (!disk_cache_enabled()) return 1;
+
+    char path[PATH_MAX];
+    cache_entry_path(st, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return 1;
+
+    struct stat cache_st;
+    if (fstat(fd, &cache_st) != 0 || (size_t)cache_st.st_size < sizeof(DiskImageHeader)) {
+        close(fd);
+        return 1;
+    }
+    void *map = mmap(NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 1;
+
+    const DiskImageHeader *header = map;
+    size_t offsets_size = sizeof(int) * ((size_t)header->line_count + 1);
+    int *line_offsets = (int *)((char *)map + sizeof(DiskImageHeader));
+    char *text = (char *)map + sizeof(DiskImageHeader) + offsets_size;
+    if (!header_matches(header, st) ||
+        (size_t)cache_st.st_size != sizeof(DiskImageHeader) + offsets_size + header->text_length + 1 ||
+        !entry_valid(header, line_offsets, text)) {
+        munmap(map, cache_st.st_size);
+        return 1;
+    }
+    image->map = map;
+    image->map_length = cache_st.st_size;
+    image->line_offsets = line_offsets;
+    image->text = text;
+    image->line_count = header->line_count;
+    return 0;
+}
+
+int disk_cache_store(const struct stat *st, const char *text, size_t text_length, const int *line_offsets, int line_count) {
+    if (!disk_cache_enabled()) return 1;
+
+    DiskImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DISK_CACHE_MAGIC, sizeof(header.magic));
+    header.dev = st->st_dev;
+    header.ino = st->st_ino;
+    header.size = st->st_size;
+    header.mtime_sec = st->st_mtim.tv_sec;
+    header.mtime_nsec = st->st_mtim.tv_nsec;
+    header.content_hash = hash_text(text, text_length);
+    header.line_count = line_count;
+    header.text_length = text_length;
+
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + 32];
+    cache_entry_path(st, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) return 1;
+    int failed = fwrite(&header, sizeof(header), 1, f) != 1 ||
+                 fwrite(line_offsets, sizeof(int), line_count + 1, f) != (size_t)line_count + 1 ||
+                 fwrite(text, 1, text_length + 1, f) != text_length + 1;
+    if (fclose(f) != 0) failed = 1;
+    if (failed || rename(tmp_path, path) != 0) {  // rename publishes the entry atomically to other shells
+        unlink(tmp_path);
+        return 1;
+    }
+    return 0;
+}
+
+void disk_cache_unmap(void *map, size_t map_length) {
+    munmap(map, map_length);
+}
@@ -0,0 +1,18 @@
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+#include <stddef.h>
+#include <sys/stat.h>
+
+typedef struct DiskImage {
+    void *map;           // whole mmap'd cache file, released with disk_cache_unmap
+    size_t map_length;
+    char *text;
+    int *line_offsets;   // line_count + 1 offsets into text
+    int line_count;
+} DiskImage;
+
+int disk_cache_enabled();
+int disk_cache_map(const struct stat *st, DiskImage *image);
+int disk_cache_store(const struct stat *st, const char *text, size_t text_length, const int *line_offsets, int line_count);
+void disk_cache_unmap(void *map, size_t map_length);
+#endif
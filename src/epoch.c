@@ -0,0 +1,92 @@
+#include "epoch.h"
+#include "config.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Epoch-based reclamation for structures read without a lock. A reader announces the global epoch
+// while it walks; memory unlinked by a writer is retired with the epoch of its removal and freed
+// once the global epoch has moved two steps past it, which needs every announcing reader to have
+// left or caught up. Retiring and collecting happen under shellmemory_lock.
+
+typedef struct Retired {
+    void *ptr;
+    void (*free_function)(void *);
+    unsigned long epoch;
+    struct Retired *next;
+} Retired;
+
+static unsigned long global_epoch = 1;
+static unsigned long slot_epoch[EPOCH_MAX_THREADS];  // 0 while the thread isn't reading
+static int slot_used[EPOCH_MAX_THREADS];
+static Retired *retired_head = NULL;
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static __thread int slot = -1;
+
+static void release_slot(void *unused) {  // thread exit
+    (void)unused;
+    __atomic_store_n(&slot_epoch[slot], 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot_used[slot], 0, __ATOMIC_RELEASE);
+}
+
+static void create_slot_key() {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+static int claim_slot() {
+    pthread_once(&slot_key_once, create_slot_key);
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&slot_used[i], &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            slot = i;
+            pthread_setspecific(slot_key, &slot_used[i]);  // any non-NULL value, so the destructor runs
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int epoch_enter() {  // 0 when every slot is taken, the caller has to take the locked path
+    if (slot == -1 && claim_slot()) return 0;
+    __atomic_store_n(&slot_epoch[slot], __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+void epoch_exit() {
+    __atomic_store_n(&slot_epoch[slot], 0, __ATOMIC_RELEASE);
+}
+
+static void try_advance() {
+    unsigned long epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+        unsigned long reader = __atomic_load_n(&slot_epoch[i], __ATOMIC_SEQ_CST);
+        if (reader != 0 && reader != epoch) return;  // still reading in an older epoch
+    }
+    __atomic_store_n(&global_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+}
+
+void epoch_retire(void *ptr, void (*free_function)(void *)) {
+    Retired *retired = malloc(sizeof(Retired));
+    if (retired == NULL) return;  // leaked rather than freed under a reader
+    retired->ptr = ptr;
+    retired->free_function = free_function;
+    retired->epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    retired->next = retired_head;
+    retired_head = retired;
+
+    try_advance();
+    try_advance();  // with no reader in, what was just retired is freed right away
+    unsigned long epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    Retired **link = &retired_head;
+    while (*link != NULL) {
+        Retired *curr = *link;
+        if (curr->epoch + 2 <= epoch) {
+            *link = curr->next;
+            curr->free_function(curr->ptr);
+            free(curr);
+        }
+        else {
+            link = &curr->next;
+        }
+    }
+}
@@ -0,0 +1,6 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+int epoch_enter();
+void epoch_exit();
+void epoch_retire(void *ptr, void (*free_function)(void *));
+#endif
@@ -0,0 +1,109 @@
+#include "fairtree.h"
+#include <stdlib.h>
+
+// AVL tree of runnable PCBs ordered by (vruntime, seq)
+
+static unsigned long next_seq = 0;
+
+static int height(FairNode *node) {
+    return (node == NULL) ? 0 : node->height;
+}
+
+static void update_height(FairNode *node) {
+    int left = height(node->left);
+    int right = height(node->right);
+    node->height = 1 + ((left > right) ? left : right);
+}
+
+static int key_less(FairNode *a, FairNode *b) {
+    if (a->vruntime != b->vruntime) return a->vruntime < b->vruntime;
+    return a->seq < b->seq;
+}
+
+static FairNode *rotate_right(FairNode *node) {
+    FairNode *pivot = node->left;
+    node->left = pivot->right;
+    pivot->right = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+static FairNode *rotate_left(FairNode *node) {
+    FairNode *pivot = node->right;
+    node->right = pivot->left;
+    pivot->left = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+static FairNode *rebalance(FairNode *node) {
+    update_height(node);
+    int balance = height(node->left) - height(node->right);
+    if (balance > 1) {
+        if (height(node->left->left) < height(node->left->right)) node->left = rotate_left(node->left);
+        return rotate_right(node);
+    }
+    if (balance < -1) {
+        if (height(node->right->right) < height(node->right->left)) node->right = rotate_right(node->right);
+        return rotate_left(node);
+    }
+    return node;
+}
+
+static FairNode *insert_node(FairNode *root, FairNode *node, FairNode **predecessor) {
+    if (root == NULL) return node;
+    if (key_less(node, root)) {
+        root->left = insert_node(root->left, node, predecessor);
+    }
+    else {
+        *predecessor = root;  // last node we went right of is the closest smaller key
+        root->right = insert_node(root->right, node, predecessor);
+    }
+    return rebalance(root);
+}
+
+// Inserts pcb and reports the node just before it in key order, NULL when it is the new minimum
+FairNode *fair_tree_insert(FairNode **root, PCB *pcb, unsigned long vruntime, FairNode **predecessor) {
+    FairNode *node = malloc(sizeof(FairNode));
+    if (node == NULL) return NULL;
+    node->pcb = pcb;
+    node->vruntime = vruntime;
+    node->seq = next_seq++;
+    node->left = NULL;
+    node->right = NULL;
+    node->height = 1;
+    *predecessor = NULL;
+    *root = insert_node(*root, node, predecessor);
+    return node;
+}
+
+static FairNode *remove_min(FairNode *root, FairNode **min) {
+    if (root->left == NULL) {
+        *min = root;
+        return root->right;
+    }
+    root->left = remove_min(root->left, min);
+    return rebalance(root);
+}
+
+static FairNode *remove_node(FairNode *root, FairNode *node) {
+    if (root == NULL) return NULL;
+    if (root == node) {
+        if (root->left == NULL) return root->right;
+        if (root->right == NULL) return root->left;
+        FairNode *successor;
+        FairNode *right = remove_min(root->right, &successor);
+        successor->left = root->left;
+        successor->right = right;
+        return rebalance(successor);
+    }
+    if (key_less(node, root)) root->left = remove_node(root->left, node);
+    else root->right = remove_node(root->right, node);
+    return rebalance(root);
+}
+
+void fair_tree_remove(FairNode **root, FairNode *node) {
+    *root = remove_node(*root, node);
+}
@@ -0,0 +1,16 @@
+#ifndef FAIRTREE_H
+#define FAIRTREE_H
+typedef struct PCB PCB;
+
+typedef struct FairNode {
+    PCB *pcb;
+    unsigned long vruntime;
+    unsigned long seq;  // breaks vruntime ties in arrival order, keeps keys unique
+    struct FairNode *left;
+    struct FairNode *right;
+    int height;
+} FairNode;
+
+FairNode *fair_tree_insert(FairNode **root, PCB *pcb, unsigned long vruntime, FairNode **predecessor);
+void fair_tree_remove(FairNode **root, FairNode *node);
+#endif
@@ -0,0 +1,179 @@
+#include "framemap.h"
+#include "config.h"
+#include "program.h"
+#include "shellmemory.h"
+#include "buddy.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Reverse map from a page's first frame to every (program, page) mapping it, and with
+// dedup on, an index of loaded pages by content so identical pages share one frame.
+
+typedef struct Mapping {
+    Program *program;
+    int page_number;
+    struct Mapping *next;
+} Mapping;
+
+static Mapping **mappings;
+static int *map_count;
+static unsigned long *content_hash;
+static int *indexed;
+static int *index_next;   // chains of indexed frames per bucket, -1 terminated
+static int *index_buckets;
+static int num_frames = 0;
+
+static unsigned long hash_page(Program *p, int page_number) {  // FNV-1a over the page's lines
+    unsigned long hash = 14695981039346656037UL;
+    int page_size = program_get_page_size(p);
+    int length = program_get_length(p);
+    for (int i = page_number * page_size; i < length && i < (page_number + 1) * page_size; i++) {
+        int line_length;
+        const char *line = program_get_line(p, i, &line_length);
+        if (line == NULL) return 0;
+        for (int j = 0; j < line_length; j++) {
+            hash ^= (unsigned char)line[j];
+            hash *= 1099511628211UL;
+        }
+        hash ^= 0xff;  // line separator, so line boundaries count
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static int page_matches_frame(Program *p, int page_number, int frame_number) {
+    int page_size = program_get_page_size(p);
+    int length = program_get_length(p);
+    int first_line = page_number * page_size;
+    for (int i = 0; i < page_size; i++) {
+        const char *stored = frame_store_line(frame_number * frame_size + i);
+        if (first_line + i >= length) {
+            if (stored != NULL) return 0;
+            continue;
+        }
+        int line_length;
+        const char *line = program_get_line(p, first_line + i, &line_length);
+        if (stored == NULL || line == NULL) return 0;
+        if (strlen(stored) != (size_t)line_length || memcmp(stored, line, line_length) != 0) return 0;
+    }
+    return 1;
+}
+
+static void rebuild_index() {
+    for (int i = 0; i < num_frames; i++) index_buckets[i] = -1;
+    for (int i = 0; i < num_frames; i++) {
+        if (!indexed[i]) continue;
+        int bucket = content_hash[i] % num_frames;
+        index_next[i] = index_buckets[bucket];
+        index_buckets[bucket] = i;
+    }
+}
+
+int framemap_grow(int num_of_frames) {
+    if (num_of_frames <= num_frames) return 0;
+    Mapping **new_mappings = realloc(mappings, sizeof(Mapping *) * num_of_frames);
+    if (new_mappings == NULL) return 1;
+    mappings = new_mappings;
+    int *new_count = realloc(map_count, sizeof(int) * num_of_frames);
+    if (new_count == NULL) return 1;
+    map_count = new_count;
+    unsigned long *new_hash = realloc(content_hash, sizeof(unsigned long) * num_of_frames);
+    if (new_hash == NULL) return 1;
+    content_hash = new_hash;
+    int *new_indexed = realloc(indexed, sizeof(int) * num_of_frames);
+    if (new_indexed == NULL) return 1;
+    indexed = new_indexed;
+    int *new_next = realloc(index_next, sizeof(int) * num_of_frames);
+    if (new_next == NULL) return 1;
+    index_next = new_next;
+    int *new_buckets = realloc(index_buckets, sizeof(int) * num_of_frames);
+    if (new_buckets == NULL) return 1;
+    index_buckets = new_buckets;
+
+    for (int i = num_frames; i < num_of_frames; i++) {
+        mappings[i] = NULL;
+        map_count[i] = 0;
+        indexed[i] = 0;
+    }
+    num_frames = num_of_frames;
+    rebuild_index();
+    return 0;
+}
+
+int framemap_init(int num_of_frames) {
+    return framemap_grow(num_of_frames);
+}
+
+int framemap_add(int frame_number, Program *p, int page_number) {
+    Mapping *m = malloc(sizeof(Mapping));
+    if (m == NULL) return 1;
+    m->program = p;
+    m->page_number = page_number;
+    m->next = mappings[frame_number];
+    mappings[frame_number] = m;
+    map_count[frame_number]++;
+    return 0;
+}
+
+// Drops one mapping, returns how many are left on the frame
+int framemap_remove(int frame_number, Program *p, int page_number) {
+    for (Mapping **curr = &mappings[frame_number]; *curr != NULL; curr = &(*curr)->next) {
+        if ((*curr)->program == p && (*curr)->page_number == page_number) {
+            Mapping *m = *curr;
+            *curr = m->next;
+            free(m);
+            map_count[frame_number]--;
+            break;
+        }
+    }
+    return map_count[frame_number];
+}
+
+int framemap_pop(int frame_number, Program **p, int *page_number) {
+    if (framemap_first(frame_number, p, page_number)) return 1;
+    framemap_remove(frame_number, *p, *page_number);
+    return 0;
+}
+
+int framemap_first(int frame_number, Program **p, int *page_number) {
+    if (frame_number < 0 || frame_number >= num_frames || mappings[frame_number] == NULL) return 1;
+    *p = mappings[frame_number]->program;
+    *page_number = mappings[frame_number]->page_number;
+    return 0;
+}
+
+int framemap_count(int frame_number) {
+    return map_count[frame_number];
+}
+
+// A loaded frame holding exactly this page's lines, -1 if there is none
+int framemap_find_shared(Program *p, int page_number) {
+    if (!dedup_pages) return -1;
+    unsigned long hash = hash_page(p, page_number);
+    for (int f = index_buckets[hash % num_frames]; f != -1; f = index_next[f]) {
+        if (content_hash[f] == hash && buddy_block_order(f) == program_get_page_order(p) && page_matches_frame(p, page_number, f)) {
+            return f;
+        }
+    }
+    return -1;
+}
+
+void framemap_index(int frame_number, Program *p, int page_number) {
+    if (!dedup_pages) return;
+    content_hash[frame_number] = hash_page(p, page_number);
+    indexed[frame_number] = 1;
+    int bucket = content_hash[frame_number] % num_frames;
+    index_next[frame_number] = index_buckets[bucket];
+    index_buckets[bucket] = frame_number;
+}
+
+void framemap_unindex(int frame_number) {
+    if (!indexed[frame_number]) return;
+    indexed[frame_number] = 0;
+    for (int *curr = &index_buckets[content_hash[frame_number] % num_frames]; *curr != -1; curr = &index_next[*curr]) {
+        if (*curr == frame_number) {
+            *curr = index_next[frame_number];
+            break;
+        }
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef FRAMEMAP_H
+#define FRAMEMAP_H
+typedef struct Program Program;
+int framemap_init(int num_of_frames);
+int framemap_grow(int num_of_frames);
+int framemap_add(int frame_number, Program *p, int page_number);
+int framemap_remove(int frame_number, Program *p, int page_number);
+int framemap_pop(int frame_number, Program **p, int *page_number);
+int framemap_first(int frame_number, Program **p, int *page_number);
+int framemap_count(int frame_number);
+int framemap_find_shared(Program *p, int page_number);
+void framemap_index(int frame_number, Program *p, int page_number);
+void framemap_unindex(int frame_number);
+#endif
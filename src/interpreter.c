@@ -13,6 +13,11 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include "interpreter.h"
+#include "coldtier.h"
+#include <limits.h>
+#include "coroutine.h"
+#include "metrics.h"
+#include "trace.h"
 
 int MAX_ARGS_SIZE = 7;
 int multithreaded_mode = 0;
@@ -30,6 +35,11 @@ int badcommandFileDoesNotExist() {
     return 3;
 }
 
+int badcommandDeadlineNotAdmitted(const char *script) {
+    printf("Bad command: Deadline of %s can't be met\n", script);
+    return 4;
+}
+
 
 // Interpret commands and their arguments
 int interpreter(char *command_args[], int args_size) {
@@ -124,6 +134,16 @@ int interpreter(char *command_args[], int args_size) {
         command_args[args_size - 1] = NULL;
         return run(command_args);
     } 
+    else if (strcmp(command_args[0], "stats") == 0) {
+        if (args_size == 2 && strcmp(command_args[1], "processes") == 0) {
+            metrics_print();
+            return 0;
+        }
+        if (args_size != 1) {
+            return badcommand();
+        }
+        return stats();
+    } 
     else if (strcmp(command_args[0], "exec") == 0) {
         if (args_size > MAX_ARGS_SIZE || args_size < 3) {
             return 1;
@@ -148,27 +168,36 @@ source SCRIPT.TXT	Executes the file SCRIPT.TXT\n ";
 }
 
 int quit() {
+    if (defer_scheduling) scheduler_drain_deferred(&ready_queue);  // typed at the prompt, the queued scripts finish first
     printf("Bye!\n");
 
     if (multithreaded_mode) {
         // only the main thread can handle quit and joining the threads
         if (pthread_equal(pthread_self(), main_thread_id)) {
             handle_quit();
+            metrics_report_on_exit();
             exit(0);
         } else {
             // if a worker called quit, we raise request_quit flag to let main know to finish
             // when stdin is empty
-            pthread_mutex_lock(&ready_queue_lock);
+            trace_lock(&ready_queue_lock, "ready_queue_lock");
             request_quit = 1;
-            pthread_cond_broadcast(&queue_not_empty);
             pthread_mutex_unlock(&ready_queue_lock);
             return 0;
         }
         return 0;
     }
+    metrics_report_on_exit();
     exit(0);
 }
 
+int stats() {
+    cold_tier_print_stats();
+    edf_print_stats();
+    if (multithreaded_mode) mt_print_stats();
+    return 0;
+}
+
 int set(char *var, char *value) {
     // Challenge: allow setting VAR to the rest of the input line,
     // possibly including spaces.
@@ -189,7 +218,8 @@ int print(char *var) {
 int source(char *script) {
     const char *policy_string = "FCFS";  // source only executes one script, so any scheduling policy would act the same
     Policy *fcfs_policy = parse_policy(policy_string);
-    int errCode = create_pcb_and_enqueue(script, &ready_queue, fcfs_policy);
+    if (defer_scheduling) scheduler_drain_deferred(&ready_queue);
+    int errCode = create_pcb_and_enqueue(script, &ready_queue, fcfs_policy, NULL);
 
     if (errCode) {
         free(fcfs_policy);
@@ -201,6 +231,40 @@ int source(char *script) {
     return errCode;
 }
 
+// Strips the @key=value suffixes off a script name, e.g. prog1@nice=5 or prog1@deadline=40
+int parse_script_options(char *script, PCBOptions *options) {
+    options->nice = 0;
+    options->deadline = 0;
+    options->period = 0;
+    char *option = strchr(script, '@');
+    if (option == NULL) return 0;
+    *option = '\0';
+    while (option != NULL) {
+        char *key = option + 1;
+        option = strchr(key, '@');
+        if (option != NULL) *option = '\0';
+        char *value = strchr(key, '=');
+        if (value == NULL) return 1;
+        *value++ = '\0';
+        char *end;
+        long number = strtol(value, &end, 10);
+        if (value[0] == '\0' || *end != '\0') return 1;
+        if (strcmp(key, "nice") == 0 && number >= -20 && number <= 19) {
+            options->nice = number;
+        }
+        else if (strcmp(key, "deadline") == 0 && number > 0 && number <= INT_MAX) {
+            options->deadline = number;
+        }
+        else if (strcmp(key, "period") == 0 && number > 0 && number <= INT_MAX) {
+            options->period = number;
+        }
+        else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int exec(int argc, char *argv[]) {
     const char *multithread_flag = argv[argc - 1];
     int policy_idx = argc - 1;
@@ -229,31 +293,47 @@ int exec(int argc, char *argv[]) {
         return 1;
     }
 
+    // typed at the interactive prompt: queue the scripts and let the shell's event loop run them
+    int deferred = defer_scheduling && !multithreaded_mode && !background_mode;
+    if (defer_scheduling && (!deferred || scheduler_defer(active_policy))) {
+        scheduler_drain_deferred(&ready_queue);  // the queue can't mix policies, nor go to the workers half run
+        if (deferred) scheduler_defer(active_policy);
+    }
 
-
+    PCB *pcbs[MAX_ARGS_SIZE];  // every script is loaded before any of them is queued
+    PCBOptions options[MAX_ARGS_SIZE];
     for (int i = 0; i < policy_idx; i++) {
- 
-        char *script = argv[i]; 
-
-        if (multithreaded_mode) {
-            pthread_mutex_lock(&ready_queue_lock);
+        if (parse_script_options(argv[i], &options[i])) {
+            free(active_policy);
+            return badcommand();
         }
+    }
+    if (create_pcbs(argv, options, policy_idx, pcbs) != -1) {
+        free(active_policy);
+        return badcommandFileDoesNotExist();
+    }
 
-        errCode = create_pcb_and_enqueue(script, &ready_queue, active_policy);
+    if (multithreaded_mode) {
+        trace_lock(&ready_queue_lock, "ready_queue_lock");
+    }
 
-        if (multithreaded_mode) {
-            pthread_mutex_unlock(&ready_queue_lock);
-        }
+    errCode = admit_and_enqueue_batch(pcbs, policy_idx, &ready_queue, active_policy);
 
-        if (errCode) {
-            free(active_policy);
-            return badcommandFileDoesNotExist();
-        }
+    if (multithreaded_mode) {
+        pthread_mutex_unlock(&ready_queue_lock);
+    }
+
+    if (errCode) {  // the PCBs that weren't queued are already destroyed, the queued ones still run
+        free(active_policy);
+        return errCode;
+    }
+    for (int i = 0; i < policy_idx; i++) {
+        if (pcbs[i] == NULL) badcommandDeadlineNotAdmitted(argv[i]);  // the other scripts still run
     }
 
     if (background_mode) {
         if (multithreaded_mode) {
-            pthread_mutex_lock(&ready_queue_lock);
+            trace_lock(&ready_queue_lock, "ready_queue_lock");
         }
 
         errCode = create_batch_script_pcb_and_enqueue();
@@ -270,7 +350,7 @@ int exec(int argc, char *argv[]) {
 
     if (multithreaded_mode) {
         errCode = run_multithreaded_scheduler(&ready_queue, active_policy);
-    } else {
+    } else if (!deferred) {
         errCode = run_scheduler(&ready_queue, active_policy);
     }
 
@@ -387,6 +467,8 @@ int run(char *args[]) {
         return 1;
     } 
     else if (pid > 0) {
+        // a PCB running on a coroutine suspends until a waiter thread reaps the child (coroutine.c)
+        if (!coroutine_wait_child(pid)) return 0;
         // if we are in the parent process we wait
         // waitpid waits specifically for the child process with id = pid
         if (waitpid(pid, NULL, 0) != pid) {
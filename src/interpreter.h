@@ -1,12 +1,15 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
+#include "pcb.h"
 int interpreter(char *command_args[], int args_size);
 int help();
 int quit();
+int stats();
 int set(char *var, char *value);
 int print(char *var);
 int source(char *script);
 int exec(int argc, char *argv[]);
+int parse_script_options(char *script, PCBOptions *options);
 int echo(char *token);
 int my_ls();
 int my_mkdir(char *dirname);
@@ -14,4 +17,5 @@ int my_touch(char *filename);
 int my_cd(char *dirname);
 int run(char *args[]);
 int badcommandFileDoesNotExist();
+int badcommandDeadlineNotAdmitted(const char *script);
 #endif
\ No newline at end of file
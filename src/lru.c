@@ -1,69 +1,146 @@
 #include "lru.h"
 #include "config.h"
+#include "shellmemory.h"
 #include <stdlib.h>
 
-typedef struct FrameNumberNode {
-    int frame_number;
-    FrameNumberNode *prev;
-    FrameNumberNode *next;
-} FrameNumberNode;
+// Frames in a list from least to most recently used, so eviction takes the head without a scan.
+// update_mru runs on every instruction without a lock: it stamps the frame from a use clock and, on its
+// first use since the last eviction, pushes it on a lock-free pending stack. Eviction, under
+// shellmemory_lock, first moves the pending frames to the MRU end in stamp order, which leaves the list
+// exactly as moving each frame on every use would have. A frame whose pending flag a worker sees set
+// just as eviction clears it keeps its older place until its next use.
 
-static FrameNumberNode *head;
-static FrameNumberNode *tail; 
+#define NO_FRAME -1
+#define NOT_IN_LRU -2  // lru_prev of a frame inside a multi-frame page, the page ages through its first frame
 
-static FrameNumberNode *lru_map[FRAME_STORE_SIZE/FRAME_SIZE];
+typedef struct Drained {
+    long stamp;  // read once, a worker may use the frame again while eviction sorts
+    int frame;
+} Drained;
+
+static long *lru_stamp;     // last use, 0 once put back at the LRU end, atomic
+static char *lru_pending;   // set while the frame is on the pending stack, atomic
+static int *pending_next;
+static int pending_head = NO_FRAME;  // atomic
+static Drained *drained;    // the pending frames, while eviction sorts them
+static long lru_clock;      // most recent use, atomic
+
+static int *lru_prev;       // the list, under shellmemory_lock
+static int *lru_next;
+static int lru_head = NO_FRAME;  // least recently used
+static int lru_tail = NO_FRAME;  // most recently used
+static int lru_map_length;
+
+static void lru_unlink(int frame_number) {
+    int prev = lru_prev[frame_number];
+    int next = lru_next[frame_number];
+    if (prev == NO_FRAME) lru_head = next;
+    else lru_next[prev] = next;
+    if (next == NO_FRAME) lru_tail = prev;
+    else lru_prev[next] = prev;
+    lru_prev[frame_number] = NOT_IN_LRU;
+}
+
+static void lru_link_tail(int frame_number) {
+    lru_prev[frame_number] = lru_tail;
+    lru_next[frame_number] = NO_FRAME;
+    if (lru_tail == NO_FRAME) lru_head = frame_number;
+    else lru_next[lru_tail] = frame_number;
+    lru_tail = frame_number;
+}
+
+static void lru_link_head(int frame_number) {
+    lru_prev[frame_number] = NO_FRAME;
+    lru_next[frame_number] = lru_head;
+    if (lru_head == NO_FRAME) lru_tail = frame_number;
+    else lru_prev[lru_head] = frame_number;
+    lru_head = frame_number;
+}
 
 int lru_map_init() {
-    head = malloc(sizeof(FrameNumberNode));
-    if (head == NULL) return 1;
-    head->prev = NULL; 
-    head->frame_number = 0;
-    FrameNumberNode* prev = head;
-    for (int i=1; i<FRAME_STORE_SIZE/FRAME_SIZE; i++) {
-        FrameNumberNode *new = malloc(sizeof(FrameNumberNode));
-        if (new == NULL) return 1;
-        new->prev = prev;
-        new->frame_number = i;
-        lru_map[i] = new;
-        lru_map[i-1] = prev;
-        prev->next = new;
-        prev = new;
+    int max_frames = frame_store_max_frames();  // sized for growth, update_mru never races a realloc
+    lru_map_length = frame_store_size/frame_size;
+    lru_stamp = calloc(max_frames, sizeof(long));
+    lru_pending = calloc(max_frames, sizeof(char));
+    pending_next = malloc(sizeof(int) * max_frames);
+    drained = malloc(sizeof(Drained) * max_frames);
+    lru_prev = malloc(sizeof(int) * max_frames);
+    lru_next = malloc(sizeof(int) * max_frames);
+    if (lru_stamp == NULL || lru_pending == NULL || pending_next == NULL || drained == NULL || lru_prev == NULL || lru_next == NULL) {
+        return 1;
+    }
+    lru_head = lru_tail = NO_FRAME;
+    for (int i=lru_map_length-1; i>=0; i--) {
+        lru_link_tail(i);  // frame 0 most recently used, the last frame least
     }
-    tail = prev;
-    tail->next = NULL;
+    lru_clock = 0;
+    pending_head = NO_FRAME;
     return 0;
 }
 
-void update_mru(int frame_number) { 
-    FrameNumberNode* curr = lru_map[frame_number];
-    if (curr == head) { 
-        return;
+int lru_map_grow(int num_of_frames) {
+    if (num_of_frames > frame_store_max_frames()) return 1;
+    for (int i=lru_map_length; i<num_of_frames; i++) {
+        lru_link_head(i);
     }
+    lru_map_length = num_of_frames;
+    return 0;
+}
 
-    FrameNumberNode* prev = curr->prev;
-    FrameNumberNode* next = curr->next;
-    if (curr == tail) {
-        tail = prev;
-        tail->next = NULL;      
+void update_mru(int frame_number) {
+    __atomic_store_n(&lru_stamp[frame_number], __atomic_add_fetch(&lru_clock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    if (__atomic_load_n(&lru_pending[frame_number], __ATOMIC_RELAXED) ||
+        __atomic_exchange_n(&lru_pending[frame_number], 1, __ATOMIC_ACQ_REL)) {
+        return;  // already on the stack, eviction reads the new stamp
     }
-    else {
-        next->prev = prev;
+    int head = __atomic_load_n(&pending_head, __ATOMIC_RELAXED);
+    do {
+        pending_next[frame_number] = head;
+    } while (!__atomic_compare_exchange_n(&pending_head, &head, frame_number, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static int compare_stamps(const void *a, const void *b) {
+    long x = ((const Drained *)a)->stamp;
+    long y = ((const Drained *)b)->stamp;
+    return (x > y) - (x < y);
+}
+
+static void lru_drain_pending() {  // caller holds shellmemory_lock
+    int n_drained = 0;
+    for (int frame = __atomic_exchange_n(&pending_head, NO_FRAME, __ATOMIC_ACQUIRE); frame != NO_FRAME; frame = pending_next[frame]) {
+        drained[n_drained++].frame = frame;  // the whole chain first, a frame is pushed again once its flag clears
+    }
+    for (int i = 0; i < n_drained; i++) {
+        __atomic_store_n(&lru_pending[drained[i].frame], 0, __ATOMIC_SEQ_CST);
+        drained[i].stamp = __atomic_load_n(&lru_stamp[drained[i].frame], __ATOMIC_SEQ_CST);
     }
-    prev->next = next;
-    curr->prev = NULL;
-    curr->next = head;
-    head->prev = curr;
-    head = curr; 
+    qsort(drained, n_drained, sizeof(Drained), compare_stamps);
+    for (int i = 0; i < n_drained; i++) {
+        int frame = drained[i].frame;
+        if (lru_prev[frame] == NOT_IN_LRU || drained[i].stamp == 0) {
+            continue;  // left the order, or was put back at the LRU end after its use
+        }
+        lru_unlink(frame);
+        lru_link_tail(frame);
+    }
+}
+
+int get_lru_and_reorder() {  // caller holds shellmemory_lock
+    lru_drain_pending();
+    int lru = lru_head;
+    if (lru == NO_FRAME) return -1;
+    lru_unlink(lru);
+    lru_link_tail(lru);
+    return lru;
+}
+
+// Frames inside a multi-frame page leave the order, the page ages through its first frame
+void lru_remove(int frame_number) {
+    if (lru_prev[frame_number] != NOT_IN_LRU) lru_unlink(frame_number);
 }
 
-int get_lru_and_reorder() {
-    FrameNumberNode *lru = tail;
-    FrameNumberNode *new_tail= tail->prev;
-    new_tail->next = NULL;
-    lru->next = head;
-    lru->prev = NULL;
-    tail = new_tail;
-    head->prev = lru;
-    head = lru;
-    return lru->frame_number;
+void lru_append(int frame_number) {
+    if (lru_prev[frame_number] != NOT_IN_LRU) lru_unlink(frame_number);
+    __atomic_store_n(&lru_stamp[frame_number], 0, __ATOMIC_RELAXED);
+    lru_link_head(frame_number);
 }
@@ -1,7 +1,9 @@
 #ifndef LRU_H
 #define LRU_H
-typedef struct FrameNumberNode FrameNumberNode;
 int lru_map_init();  
+int lru_map_grow(int num_of_frames);
 int get_lru_and_reorder();
 void update_mru(int frame_number);
+void lru_remove(int frame_number);
+void lru_append(int frame_number);
 #endif
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "metrics.h"
+#include "config.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static unsigned long clock_ticks = 0;  // instructions executed by every PCB so far, atomic
+static ProcessTimes *records = NULL;   // one per finished PCB, in completion order
+static int record_count = 0;
+static int record_capacity = 0;
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;  // a leaf, taken under any other lock
+
+unsigned long metrics_clock() {
+    return __atomic_load_n(&clock_ticks, __ATOMIC_RELAXED);
+}
+
+void metrics_clock_advance(int instructions) {
+    __atomic_add_fetch(&clock_ticks, instructions, __ATOMIC_RELAXED);
+}
+
+long metrics_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+void metrics_record(const ProcessTimes *times) {
+    pthread_mutex_lock(&metrics_lock);
+    if (record_count == record_capacity) {
+        int capacity = (record_capacity == 0) ? 16 : record_capacity * 2;
+        ProcessTimes *grown = realloc(records, sizeof(ProcessTimes) * capacity);
+        if (grown == NULL) {  // the PCB just goes unreported
+            pthread_mutex_unlock(&metrics_lock);
+            return;
+        }
+        records = grown;
+        record_capacity = capacity;
+    }
+    records[record_count++] = *times;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank p50, p95 and p99 of the long field at offset, caller holds metrics_lock and has records
+static void percentiles(size_t offset, long *values, long result[3]) {
+    for (int i = 0; i < record_count; i++) {
+        values[i] = *(const long *)((const char *)&records[i] + offset);
+    }
+    qsort(values, record_count, sizeof(long), compare_long);
+    const int ranks[3] = {50, 95, 99};
+    for (int i = 0; i < 3; i++) {
+        int rank = (ranks[i] * record_count + 99) / 100;  // ceil(p * n / 100), at least 1
+        result[i] = values[rank - 1];
+    }
+}
+
+// The percentiles on the instruction clock and in wall time, then one line per PCB
+void metrics_print() {
+    pthread_mutex_lock(&metrics_lock);
+    if (record_count == 0) {
+        printf("Processes: none done\n");
+        pthread_mutex_unlock(&metrics_lock);
+        return;
+    }
+    long *values = malloc(sizeof(long) * record_count);
+    if (values == NULL) {
+        pthread_mutex_unlock(&metrics_lock);
+        return;
+    }
+    long wait[3], response[3], turnaround[3];
+    percentiles(offsetof(ProcessTimes, wait), values, wait);
+    percentiles(offsetof(ProcessTimes, response), values, response);
+    percentiles(offsetof(ProcessTimes, turnaround), values, turnaround);
+    printf("Processes: %d done, p50/p95/p99 wait %ld/%ld/%ld, response %ld/%ld/%ld, turnaround %ld/%ld/%ld instructions\n",
+           record_count, wait[0], wait[1], wait[2], response[0], response[1], response[2], turnaround[0], turnaround[1], turnaround[2]);
+
+    percentiles(offsetof(ProcessTimes, wait_ns), values, wait);
+    percentiles(offsetof(ProcessTimes, response_ns), values, response);
+    percentiles(offsetof(ProcessTimes, turnaround_ns), values, turnaround);
+    printf("Processes: p50/p95/p99 wait %.1f/%.1f/%.1f, response %.1f/%.1f/%.1f, turnaround %.1f/%.1f/%.1f us\n",
+           wait[0] / 1000.0, wait[1] / 1000.0, wait[2] / 1000.0, response[0] / 1000.0, response[1] / 1000.0,
+           response[2] / 1000.0, turnaround[0] / 1000.0, turnaround[1] / 1000.0, turnaround[2] / 1000.0);
+    for (int i = 0; i < record_count; i++) {
+        ProcessTimes *t = &records[i];
+        printf("  %d %s: %lu instructions, %lu faults, %lu dispatches, wait %ld (%.1f us), blocked %ld (%.1f us), response %ld (%.1f us), turnaround %ld (%.1f us)\n",
+               t->pid, t->name, t->instructions, t->faults, t->dispatches, t->wait, t->wait_ns / 1000.0, t->blocked,
+               t->blocked_ns / 1000.0, t->response, t->response_ns / 1000.0, t->turnaround, t->turnaround_ns / 1000.0);
+    }
+    free(values);
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_report_on_exit() {
+    if (stats_on_exit) metrics_print();
+}
@@ -0,0 +1,29 @@
+#ifndef METRICS_H
+#define METRICS_H
+#define METRICS_NAME_LENGTH 32
+
+// Scheduling times of a finished PCB, on the instruction clock (instructions the shell executed
+// meanwhile, reproducible in single-threaded mode) and in nanoseconds of wall time
+typedef struct ProcessTimes {
+    int pid;
+    char name[METRICS_NAME_LENGTH];
+    unsigned long instructions;
+    unsigned long faults;
+    unsigned long dispatches;
+    long wait;        // in the ready queue
+    long blocked;     // suspended on a run child, not counted as wait
+    long response;    // created to first dispatch
+    long turnaround;  // created to completion
+    long wait_ns;
+    long blocked_ns;
+    long response_ns;
+    long turnaround_ns;
+} ProcessTimes;
+
+unsigned long metrics_clock();
+void metrics_clock_advance(int instructions);
+long metrics_now_ns();
+void metrics_record(const ProcessTimes *times);
+void metrics_print();
+void metrics_report_on_exit();
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // CPU affinity
 #include "mt_scheduler.h"
 #include "policies.h"
 #include "readyqueue.h"
@@ -5,8 +6,34 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "pcbring.h"
+#include "config.h"
+#include "coroutine.h"
+#include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <stdint.h>
+#include "trace.h"
 
-pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER;
+// Lock order, a thread holding one of these only takes the ones below it:
+//   interpreter_lock   one shell command at a time, a nested exec goes on to take the locks below
+//   ready_queue_lock   the ready queue, worker idle list and wake statistics
+//   shellmemory_lock   frame allocation and eviction, the buddy allocator, frame map, cold tier,
+//                      program table and reclaim list, spooled line offsets
+//   Program table_lock one program's page table; eviction takes the lock of every program mapping
+//                      the victim frame (one at a time) before freeing it
+// Executing a line only takes the running program's table_lock, the frame store itself has no lock:
+// a frame's lines live as long as a page table maps them, and LRU stamps are atomic (lru.c).
+// A page table entry is written with both shellmemory_lock and its table_lock held, so either one
+// is enough to read it.
+pthread_cond_t all_idle = PTHREAD_COND_INITIALIZER;  // handle_quit waits here for the queue to drain
 pthread_mutex_t ready_queue_lock = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t interpreter_lock = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t shellmemory_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -17,44 +44,385 @@ static WorkerArgs *worker_args = NULL;
 static Policy shared_policy;
 int request_quit = 0;
 static int workers_active = 0;
+static int blocked_pcbs = 0;  // suspended on a run child, under ready_queue_lock
+
+// Each idle worker sleeps on its own condvar, so a new PCB wakes exactly one of them
+typedef struct WorkerSlot {
+    pthread_cond_t wake;
+    int idle;
+    struct timespec woken_at;
+    struct WorkerSlot *next_idle;
+} WorkerSlot;
+
+static WorkerSlot slots[THREAD_NUMBER];
+static WorkerSlot *idle_workers = NULL;  // stack, the most recently idle worker has the warmest cache
+static unsigned long wakeups = 0;        // wake statistics, under ready_queue_lock
+static unsigned long wasted_wakeups = 0;
+static long wake_latency_total_ns = 0;
+static long wake_latency_max_ns = 0;
+static unsigned long migrations = 0;     // slices a PCB ran on another worker than its previous one, atomic
+
+static void wake_idle_worker() {  // caller holds ready_queue_lock
+    WorkerSlot *slot = idle_workers;
+    if (slot == NULL) return;
+    idle_workers = slot->next_idle;
+    slot->idle = 0;
+    clock_gettime(CLOCK_MONOTONIC, &slot->woken_at);
+    pthread_cond_signal(&slot->wake);
+}
+
+static void wake_worker_of(PCB *pcb) {  // caller holds ready_queue_lock
+    int worker = pcb_get_worker(pcb);
+    if (sticky_workers && worker >= 0 && slots[worker].idle) {  // move the worker that last ran pcb to the top
+        WorkerSlot **link = &idle_workers;
+        while (*link != &slots[worker]) link = &(*link)->next_idle;
+        *link = slots[worker].next_idle;
+        slots[worker].next_idle = idle_workers;
+        idle_workers = &slots[worker];
+    }
+    wake_idle_worker();
+}
+
+static void wait_for_work(WorkerSlot *slot, ReadyQueue *queue) {  // caller holds ready_queue_lock
+    while (queue->head == NULL && !thread_shutdown) {
+        slot->idle = 1;
+        slot->next_idle = idle_workers;
+        idle_workers = slot;
+        while (slot->idle && !thread_shutdown) {
+            pthread_cond_wait(&slot->wake, &ready_queue_lock);
+        }
+        if (thread_shutdown) break;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long latency = (now.tv_sec - slot->woken_at.tv_sec) * 1000000000L + (now.tv_nsec - slot->woken_at.tv_nsec);
+        wakeups++;
+        wake_latency_total_ns += latency;
+        if (latency > wake_latency_max_ns) wake_latency_max_ns = latency;
+        if (queue->head == NULL) wasted_wakeups++;
+    }
+}
+
+// FCFS and RR need no ordering beyond FIFO, so their workers share a lock-free ring instead of the
+// ready queue. exec still fills the ready queue under ready_queue_lock and fifo_drain moves it over.
+static PCBRing *fifo_ring = NULL;  // NULL when the session's policy isn't FIFO
+static int live_pcbs = 0;          // PCBs moved to the ring and not destroyed yet, handle_quit waits for 0
+static int fifo_backlog = 0;       // PCBs were left in the ready queue because the ring was at capacity
+static unsigned wake_seq = 0;      // futex word idle workers park on, bumped on every push
+static int parked = 0;
+
+// With sticky workers every worker also has a ring of its own. A PCB goes back to the ring of the
+// worker that last ran it, a worker takes new PCBs from fifo_ring first, then its own ring, and only
+// steals from the other rings when both are empty.
+static PCBRing *worker_rings[THREAD_NUMBER];  // NULL unless sticky_workers
+
+static long futex(void *word, int op, int value) {
+    return syscall(SYS_futex, word, op, value, NULL, NULL, 0);
+}
+
+static void fifo_wake(int count) {
+    __atomic_add_fetch(&wake_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&parked, __ATOMIC_SEQ_CST) > 0) futex(&wake_seq, FUTEX_WAKE_PRIVATE, count);
+}
+
+static void fifo_push(PCB *pcb) {
+    while (pcb_ring_push(fifo_ring, pcb)) {
+        sched_yield();  // live_pcbs never exceeds the capacity, a consumer is just finishing with the cell
+    }
+    fifo_wake(1);
+}
+
+static void fifo_requeue(PCB *pcb, int self) {  // self is the pushing worker, -1 for any other thread
+    int owner = pcb_get_worker(pcb);
+    if (worker_rings[0] == NULL || owner < 0) {
+        fifo_push(pcb);
+        return;
+    }
+    PCBRing *ring = worker_rings[owner];
+    while (pcb_ring_push(ring, pcb)) {
+        sched_yield();
+    }
+    if (owner != self || pcb_ring_size(ring) > 1) fifo_wake(1);  // the owner pops it next, a thief only helps with a backlog
+}
+
+static PCB *fifo_pop(int self) {
+    PCB *pcb = pcb_ring_pop(fifo_ring);
+    if (pcb != NULL || worker_rings[0] == NULL) return pcb;
+    pcb = pcb_ring_pop(worker_rings[self]);
+    for (int i = 1; pcb == NULL && i < THREAD_NUMBER; i++) {
+        pcb = pcb_ring_pop(worker_rings[(self + i) % THREAD_NUMBER]);
+    }
+    return pcb;
+}
+
+// Parks until a PCB is pushed, NULL once handle_quit shuts the workers down
+static PCB *fifo_take(int self) {
+    while (1) {
+        PCB *pcb = fifo_pop(self);
+        if (pcb != NULL) return pcb;
+        if (__atomic_load_n(&thread_shutdown, __ATOMIC_SEQ_CST)) return NULL;
+
+        unsigned seq = __atomic_load_n(&wake_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&parked, 1, __ATOMIC_SEQ_CST);
+        pcb = fifo_pop(self);  // a push before parked was raised didn't see us, check again
+        if (pcb == NULL && !__atomic_load_n(&thread_shutdown, __ATOMIC_SEQ_CST)) {
+            futex(&wake_seq, FUTEX_WAIT_PRIVATE, seq);  // returns at once if a push bumped wake_seq since
+        }
+        __atomic_sub_fetch(&parked, 1, __ATOMIC_SEQ_CST);
+        if (pcb != NULL) return pcb;
+    }
+}
+
+static void fifo_drain(ReadyQueue *queue) {  // caller holds ready_queue_lock
+    while (queue->head != NULL && __atomic_load_n(&live_pcbs, __ATOMIC_SEQ_CST) < pcb_ring_capacity(fifo_ring)) {
+        __atomic_add_fetch(&live_pcbs, 1, __ATOMIC_SEQ_CST);
+        fifo_push(ready_queue_dequeue(queue));
+    }
+    __atomic_store_n(&fifo_backlog, queue->head != NULL, __ATOMIC_SEQ_CST);
+}
+
+static void fifo_done(ReadyQueue *queue, PCB *pcb) {
+    pcb_destroy(pcb);
+    if (__atomic_sub_fetch(&live_pcbs, 1, __ATOMIC_SEQ_CST) == 0) {
+        futex(&live_pcbs, FUTEX_WAKE_PRIVATE, INT_MAX);  // handle_quit
+    }
+    if (__atomic_load_n(&fifo_backlog, __ATOMIC_SEQ_CST)) {
+        trace_lock(&ready_queue_lock, "ready_queue_lock");
+        fifo_drain(queue);
+        pthread_mutex_unlock(&ready_queue_lock);
+    }
+}
+
+static int run_slice(PCB *process, ReadyQueue *queue, Policy *policy) {
+    if (coroutines) return coroutine_run_slice(process, queue, policy);
+    return exec_program(process, queue, policy);
+}
+
+// One reaper thread watches the child of every suspended PCB through a pidfd, rather than a thread
+// per child. It only reaps the pids handed to it, so a run outside a coroutine still waits for its own.
+typedef struct ChildWait {
+    PCB *pcb;
+    ReadyQueue *queue;
+    pid_t pid;
+    int pidfd;
+} ChildWait;
+
+static ChildWait *child_waits = NULL;  // under reaper_lock
+static int n_child_waits = 0;
+static int child_waits_capacity = 0;
+static int reaper_started = 0;
+static int reaper_wake = -1;  // eventfd, tells the reaper to watch the new children too
+static pthread_mutex_t reaper_lock = PTHREAD_MUTEX_INITIALIZER;  // a leaf, the reaper drops it before requeueing
+
+// The child exited, puts the PCB back where the workers find it. A ring PCB still counts in
+// live_pcbs and any other in blocked_pcbs meanwhile. Takes ready_queue_lock.
+static void requeue_unblocked(PCB *pcb, ReadyQueue *queue) {
+    pcb_mark_unblocked(pcb);
+    if (fifo_ring != NULL) fifo_requeue(pcb, -1);
+    else {
+        trace_lock(&ready_queue_lock, "ready_queue_lock");
+        if (ready_queue_enqueue(pcb, queue, &shared_policy)) printf("Couldn't enqueue uncompleted process\n");
+        blocked_pcbs--;
+        wake_worker_of(pcb);
+        pthread_mutex_unlock(&ready_queue_lock);
+    }
+}
+
+static void *child_reaper(void *arg) {
+    (void)arg;
+    trace_register_thread("reaper");
+    struct pollfd *watched = NULL;
+    int watched_capacity = 0;
+    while (1) {
+        pthread_mutex_lock(&reaper_lock);
+        int n_watched = n_child_waits + 1;
+        if (n_watched > watched_capacity) {
+            watched_capacity = child_waits_capacity + 1;
+            watched = realloc(watched, sizeof(struct pollfd) * watched_capacity);
+            if (watched == NULL) {
+                printf("Couldn't allocate child waits\n");
+                exit(1);
+            }
+        }
+        watched[0] = (struct pollfd){reaper_wake, POLLIN, 0};
+        for (int i = 0; i < n_child_waits; i++) {
+            watched[i + 1] = (struct pollfd){child_waits[i].pidfd, POLLIN, 0};
+        }
+        pthread_mutex_unlock(&reaper_lock);
+
+        if (poll(watched, n_watched, -1) == -1) continue;
+        if (watched[0].revents & POLLIN) {
+            uint64_t added;
+            if (read(reaper_wake, &added, sizeof(added)) != sizeof(added)) continue;
+        }
+        for (int i = 1; i < n_watched; i++) {
+            if (watched[i].revents == 0) continue;
+            pthread_mutex_lock(&reaper_lock);  // only this thread removes entries, the pidfd is still there
+            int k = 0;
+            while (child_waits[k].pidfd != watched[i].fd) k++;
+            ChildWait wait = child_waits[k];
+            child_waits[k] = child_waits[--n_child_waits];
+            pthread_mutex_unlock(&reaper_lock);
+
+            if (waitpid(wait.pid, NULL, 0) != wait.pid) printf("Child process hasn't exited\n");
+            close(wait.pidfd);
+            requeue_unblocked(wait.pcb, wait.queue);
+        }
+    }
+    return NULL;
+}
+
+static int start_reaper() {  // caller holds reaper_lock
+    reaper_wake = eventfd(0, EFD_CLOEXEC);
+    if (reaper_wake == -1) return 1;
+    pthread_t reaper;
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attributes, PTHREAD_STACK_MIN + 16384);
+    int errorCode = pthread_create(&reaper, &attributes, child_reaper, NULL);
+    pthread_attr_destroy(&attributes);
+    if (errorCode) {
+        close(reaper_wake);
+        return 1;
+    }
+    reaper_started = 1;
+    return 0;
+}
+
+static int watch_child(PCB *pcb, ReadyQueue *queue, pid_t pid) {  // 1 when the reaper can't take the child
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);  // close-on-exec, a run child doesn't keep it
+    if (pidfd == -1) return 1;
+    pthread_mutex_lock(&reaper_lock);
+    int failed = !reaper_started && start_reaper();
+    if (!failed && n_child_waits == child_waits_capacity) {
+        int capacity = (child_waits_capacity == 0) ? 16 : child_waits_capacity * 2;
+        ChildWait *grown = realloc(child_waits, sizeof(ChildWait) * capacity);
+        if (grown != NULL) {
+            child_waits = grown;
+            child_waits_capacity = capacity;
+        }
+        failed = (grown == NULL);
+    }
+    if (failed) {
+        pthread_mutex_unlock(&reaper_lock);
+        close(pidfd);
+        return 1;
+    }
+    child_waits[n_child_waits++] = (ChildWait){pcb, queue, pid, pidfd};
+    pthread_mutex_unlock(&reaper_lock);
+    uint64_t added = 1;
+    if (write(reaper_wake, &added, sizeof(added)) != sizeof(added)) printf("Couldn't wake the reaper\n");
+    return 0;
+}
+
+// Hands the child of a PCB that just suspended to the reaper, or waits for it right here when there
+// is no reaper. The caller must not hold ready_queue_lock, the PCB may be requeued before this returns.
+static void wait_for_child(PCB *pcb, ReadyQueue *queue) {
+    pid_t pid = coroutine_get_wait_pid(pcb);
+    pcb_mark_blocked(pcb);
+    if (watch_child(pcb, queue, pid)) {
+        if (waitpid(pid, NULL, 0) != pid) printf("Child process hasn't exited\n");
+        requeue_unblocked(pcb, queue);
+    }
+}
+
+static void mark_running(PCB *process, int self) {
+    int previous = pcb_get_worker(process);
+    if (previous >= 0 && previous != self) __atomic_add_fetch(&migrations, 1, __ATOMIC_RELAXED);
+    pcb_set_worker(process, self);
+}
+
+static void *fifo_worker(ReadyQueue *queue, Policy *policy, int self) {  // no ready_queue_lock on the per-slice path
+    PCB *process;
+    while ((process = fifo_take(self)) != NULL) {
+        pcb_mark_dispatched(process);
+        mark_running(process, self);
+        int errorCode = run_slice(process, queue, policy);
+        if (errorCode == COROUTINE_BLOCKED) wait_for_child(process, queue);
+        else if (errorCode) return NULL;
+        else if (process_completed(process)) fifo_done(queue, process);
+        else fifo_requeue(process, self);
+    }
+    return NULL;
+}
 
 pthread_t worker[THREAD_NUMBER];
 
-int run_multithreaded_scheduler(ReadyQueue *queue, Policy *policy) {  // supports fcfs, and RR
+static int worker_cpu(int id, cpu_set_t *cpu) {  // the id-th CPU the shell may run on, wrapping around
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) return 1;
+    int target = id % CPU_COUNT(&allowed);
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &allowed) && target-- == 0) {
+            CPU_ZERO(cpu);
+            CPU_SET(i, cpu);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int run_multithreaded_scheduler(ReadyQueue *queue, Policy *policy) {  // supports every policy, the ready queue is shared under ready_queue_lock
     if (!threads_initialized) {
         int errCode = 0;
 
-        worker_args = malloc(sizeof(WorkerArgs));
+        worker_args = malloc(sizeof(WorkerArgs) * THREAD_NUMBER);
         if (worker_args == NULL) {
             printf("Couldn't allocate worker args\n");
             return 1;
         }
 
         shared_policy = *policy;
-        worker_args->policy = &shared_policy;
-        worker_args->queue = queue;
+        if (policy->enqueue_function == fcfs_enqueue) {
+            fifo_ring = pcb_ring_create(MT_RING_SIZE);
+            if (fifo_ring == NULL) {
+                printf("Couldn't allocate the ready ring\n");
+                return 1;
+            }
+            for (int i = 0; sticky_workers && i < THREAD_NUMBER; i++) {
+                worker_rings[i] = pcb_ring_create(MT_RING_SIZE);
+                if (worker_rings[i] == NULL) {
+                    printf("Couldn't allocate the ready ring\n");
+                    return 1;
+                }
+            }
+        }
         thread_shutdown = 0;
         request_quit = 0;
+        idle_workers = NULL;
 
         for (int i = 0; i < THREAD_NUMBER; i++) {
-            errCode = pthread_create(&worker[i], NULL, worker_scheduler, worker_args);
+            worker_args[i].policy = &shared_policy;
+            worker_args[i].queue = queue;
+            worker_args[i].id = i;
+            pthread_cond_init(&slots[i].wake, NULL);
+            slots[i].idle = 0;
+            pthread_attr_t attributes;
+            pthread_attr_init(&attributes);
+            cpu_set_t cpu;
+            if (pin_workers && !worker_cpu(i, &cpu)) {  // set before the thread starts, so its stack is first touched there
+                pthread_attr_setaffinity_np(&attributes, sizeof(cpu), &cpu);
+            }
+            errCode = pthread_create(&worker[i], &attributes, worker_scheduler, &worker_args[i]);
+            pthread_attr_destroy(&attributes);
             if (errCode) {
                 printf("Couldn't create thread %d\n", i);
                 return errCode;
             }
         }
-        pthread_mutex_lock(&ready_queue_lock);
+        trace_lock(&ready_queue_lock, "ready_queue_lock");
         threads_initialized = 1;
-        pthread_cond_broadcast(&queue_not_empty);
+        if (fifo_ring != NULL) fifo_drain(queue);
+        else wake_idle_worker();
         pthread_mutex_unlock(&ready_queue_lock);
         return 0;
     } 
     else {
-        pthread_mutex_lock(&ready_queue_lock);
-        pthread_cond_broadcast(&queue_not_empty);  // if already initialized threads, only option is
-                                                   // that exec has been nested called
-        pthread_mutex_unlock(&ready_queue_lock);   // ReadyQueue has new PCBs, broadcast to threads so
-                                                   // they start working
+        trace_lock(&ready_queue_lock, "ready_queue_lock");
+        if (fifo_ring != NULL) fifo_drain(queue);
+        else wake_idle_worker();                 // if already initialized threads, only option is that exec has been
+                                                 // nested called, the woken worker passes the wake on if more are queued
+        pthread_mutex_unlock(&ready_queue_lock);
     }
     return 0;
 }
@@ -65,68 +433,132 @@ void *worker_scheduler(void *arg) {
     Policy *policy = arguments->policy;
     int errorCode = 0;
 
+    WorkerSlot *slot = &slots[arguments->id];
+    char thread_name[TRACE_NAME_LENGTH];
+    snprintf(thread_name, sizeof(thread_name), "worker %d", arguments->id);
+    trace_register_thread(thread_name);
+    PCB *process = NULL;  // set at the top of the loop when a sticky worker kept its PCB
+
+    if (fifo_ring != NULL) return fifo_worker(queue, policy, arguments->id);
+
     while (1) {
-        pthread_mutex_lock(&ready_queue_lock);
-        while (queue->head == NULL && !thread_shutdown) {            // queue empty and threads haven't seen a quit command yet
-            pthread_cond_wait(&queue_not_empty, &ready_queue_lock);  // we wait
-        }
-        if (thread_shutdown && queue->head == NULL) {  // if queue empty and quit command seen, worker's job is done
-            pthread_mutex_unlock(&ready_queue_lock);
-            return NULL;
+        trace_lock(&ready_queue_lock, "ready_queue_lock");
+        if (process == NULL) {
+            wait_for_work(slot, queue);  // queue empty and threads haven't seen a quit command yet, we wait
+            if (thread_shutdown && queue->head == NULL) {  // if queue empty and quit command seen, worker's job is done
+                pthread_mutex_unlock(&ready_queue_lock);
+                return NULL;
+            }
+            process = ready_queue_dequeue(queue);
+            pcb_mark_dispatched(process);
+            workers_active++;
+            if (queue->head != NULL) wake_idle_worker();  // exec woke only one worker
         }
-        PCB *process = ready_queue_dequeue(queue);
-        workers_active++;
         pthread_mutex_unlock(&ready_queue_lock);
+        mark_running(process, arguments->id);
 
-        errorCode = exec_program(process, queue, policy);
+        while (1) {
+            errorCode = run_slice(process, queue, policy);
 
-        if (errorCode) {
-            return NULL;
+            if (errorCode == COROUTINE_BLOCKED) {
+                trace_lock(&ready_queue_lock, "ready_queue_lock");
+                blocked_pcbs++;
+                break;
+            }
+            if (errorCode) {
+                return NULL;
+            }
+            trace_lock(&ready_queue_lock, "ready_queue_lock");
+            age_queue(queue);
+            if (process_completed(process) || !aging_and_score_is_smallest(process, queue, policy)) {
+                break;
+            }
+            pthread_mutex_unlock(&ready_queue_lock);  // AGING keeps the CPU while no queued score is lower, as in run_scheduler
+        }
+        PCB *blocked = NULL;
+        if (errorCode == COROUTINE_BLOCKED) {
+            blocked = process;  // handed to the reaper once we drop ready_queue_lock, which requeueing takes
         }
-        pthread_mutex_lock(&ready_queue_lock);
-        if (process_completed(process)) {
+        else if (process_completed(process)) {
             pcb_destroy(process);
         } 
         else {
             errorCode = ready_queue_enqueue(process, queue, policy);
-
-            pthread_cond_signal(&queue_not_empty);
-
             if (errorCode) {
                 printf("Couldn't enqueue uncompleted process\n");
                 return NULL;
             }
+            if (sticky_workers && queue->head == process) {  // it's next anyway, keep it and its frames on this worker
+                ready_queue_dequeue(queue);
+                pthread_mutex_unlock(&ready_queue_lock);
+                continue;
+            }
+            wake_idle_worker();
         }
+        process = NULL;
         workers_active--;
-        if (queue->head == NULL && workers_active == 0) pthread_cond_broadcast(&queue_not_empty);  // we wake up sleeping main thread in handle_quit()
+        if (queue->head == NULL && workers_active == 0) pthread_cond_signal(&all_idle);  // we wake up sleeping main thread in handle_quit()
         pthread_mutex_unlock(&ready_queue_lock);
+        if (blocked != NULL) wait_for_child(blocked, queue);
     }
 }
 
 void handle_quit() {  // can only be called by the main thread
-    pthread_mutex_lock(&ready_queue_lock);
+    trace_lock(&ready_queue_lock, "ready_queue_lock");
     if (!threads_initialized) {
         pthread_mutex_unlock(&ready_queue_lock);
         return;
     }
 
-    while (ready_queue.head != NULL || workers_active > 0) {  // we stall until all workers finish and all PCBs are executed
-        pthread_cond_wait(&queue_not_empty, &ready_queue_lock);
+    while (fifo_ring != NULL) {  // quiescent once every PCB moved to the ring is destroyed and none is left behind
+        int live = __atomic_load_n(&live_pcbs, __ATOMIC_SEQ_CST);
+        if (live == 0) {
+            if (ready_queue.head == NULL) break;
+            fifo_drain(&ready_queue);
+            continue;
+        }
+        pthread_mutex_unlock(&ready_queue_lock);
+        futex(&live_pcbs, FUTEX_WAIT_PRIVATE, live);
+        trace_lock(&ready_queue_lock, "ready_queue_lock");
+    }
+    while (ready_queue.head != NULL || workers_active > 0 || blocked_pcbs > 0) {  // we stall until all workers finish and all PCBs are executed
+        pthread_cond_wait(&all_idle, &ready_queue_lock);
     }
 
-    thread_shutdown = 1;                       // the thread which sees the quit command sets the shutdown flag
-    pthread_cond_broadcast(&queue_not_empty);  // and broadcasts to the others to wake up if waiting,
-                                               // allowing them to exit
+    __atomic_store_n(&thread_shutdown, 1, __ATOMIC_SEQ_CST);  // the thread which sees the quit command sets the shutdown flag
+    if (fifo_ring != NULL) fifo_wake(INT_MAX);
+    for (int i = 0; i < THREAD_NUMBER; i++) {  // and wakes every idle worker, allowing them to exit
+        pthread_cond_signal(&slots[i].wake);
+    }
+    idle_workers = NULL;
     pthread_mutex_unlock(&ready_queue_lock);
 
     for (int i = 0; i < THREAD_NUMBER; i++) {  //
         pthread_join(worker[i], NULL);
+        pthread_cond_destroy(&slots[i].wake);
     }
-    pthread_mutex_lock(&ready_queue_lock);
+    trace_lock(&ready_queue_lock, "ready_queue_lock");
     threads_initialized = 0;
     thread_shutdown = 0;
     pthread_mutex_unlock(&ready_queue_lock);
     free(worker_args);
     worker_args = NULL;
+    pcb_ring_destroy(fifo_ring);
+    fifo_ring = NULL;
+    for (int i = 0; i < THREAD_NUMBER; i++) {
+        pcb_ring_destroy(worker_rings[i]);
+        worker_rings[i] = NULL;
+    }
     return;
 }
+
+void mt_print_stats() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);  // every thread of the shell
+    trace_lock(&ready_queue_lock, "ready_queue_lock");
+    double average_us = (wakeups == 0) ? 0.0 : wake_latency_total_ns / 1000.0 / wakeups;
+    printf("Workers: wakeups %lu, wasted %lu, wake-to-run avg %.1f us, max %.1f us, context switches %ld voluntary, %ld involuntary, migrations %lu\n",
+           wakeups, wasted_wakeups, average_us, wake_latency_max_ns / 1000.0, usage.ru_nvcsw, usage.ru_nivcsw,
+           __atomic_load_n(&migrations, __ATOMIC_RELAXED));
+    pthread_mutex_unlock(&ready_queue_lock);
+}
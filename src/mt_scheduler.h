@@ -9,9 +9,10 @@ typedef struct Policy Policy;
 typedef struct WorkerArgs {
     Policy *policy;
     ReadyQueue *queue;
+    int id;
 } WorkerArgs;
 
-extern pthread_cond_t queue_not_empty;
+extern pthread_cond_t all_idle;
 extern pthread_mutex_t ready_queue_lock;
 extern int thread_shutdown;
 extern int threads_initialized;
@@ -19,5 +20,6 @@ extern int threads_initialized;
 int run_multithreaded_scheduler(ReadyQueue *queue, Policy *policy);
 void *worker_scheduler(void *arg);
 void handle_quit();
+void mt_print_stats();
 
 #endif
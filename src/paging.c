@@ -6,23 +6,41 @@
 #include "config.h"
 #include "shellmemory.h"
 #include "lru.h"
+#include "framemap.h"
+#include "coldtier.h"
 #include <pthread.h>
+#include "trace.h"
 
 extern pthread_mutex_t shellmemory_lock;
 
-int handle_page_fault(PCB *process) { 
+static int load_missing_page(PCB *process) {
     Program *program = pcb_get_program(process);
-    int missing_page = pcb_get_pc(process)/FRAME_SIZE;
-    int frame_store_full = load_program_page(program, missing_page);
+    int page_size = program_get_page_size(program);
+    int missing_page = pcb_get_pc(process)/page_size;
+    if (program_is_streaming(program)) {  // batch script page that hasn't been read from its input yet
+        if (program_spool_lines(program, (missing_page + 1) * page_size)) return 1;
+        if (pcb_get_pc(process) >= program_get_length(program)) return 0;  // input ended right at the page boundary
+    }
+    int loaded = load_program_page(program, missing_page);
 
-    if (frame_store_full) {  
-        if (evict_lru_frame()) return 1;
-        load_program_page(program, missing_page); 
+    if (loaded == PAGE_NO_FRAME) {  
+        do {  // a page of several frames may need more than one victim before a block that large is free
+            if (evict_frame()) return 1;
+        } while ((loaded = load_program_page(program, missing_page)) == PAGE_NO_FRAME);
     }
-    else {
+    else if (loaded == PAGE_LOADED) {
         printf("Page fault!\n");
     }
-    return 0;
+    return loaded == PAGE_LOAD_FAILED;
+}
+
+int handle_page_fault(PCB *process) {  // traced from the fault through any evictions to the load
+    long start = trace_now();
+    int errorCode = load_missing_page(process);
+    Program *program = pcb_get_program(process);
+    trace_span("page fault", "pager", start, pcb_get_pid(process), program_get_name(program), "page",
+               pcb_get_pc(process) / program_get_page_size(program));
+    return errorCode;
 }
 
 int find_frame_in_prog_page_table(Program *program, int frame_number) {
@@ -38,32 +56,51 @@ int find_frame_in_prog_page_table(Program *program, int frame_number) {
 }
 
 Program *find_victim_program(int frame_number) {
-    for (int i=0; i<program_table_size;i++) {
-        Program *curr = program_table[i];
-        int page_number = find_frame_in_prog_page_table(curr, frame_number);
-        if (page_number != -1) {
-            print_victim_lines(curr, page_number); 
-            return curr;
-        }
+    Program *victim_prog;
+    int page_number;
+    if (framemap_first(frame_number, &victim_prog, &page_number)) {
+        return NULL;
     }
-    return NULL;
+    print_victim_lines(victim_prog, page_number); 
+    return victim_prog;
 }
 
+// Unmaps the frame from every page table sharing it, then frees it
 int evict_program_frame(Program *p, int frame_idx) { 
-    int frame_number = frame_idx / FRAME_SIZE;
-    int page_number = find_frame_in_prog_page_table(p, frame_number);
-    int* page_table = program_get_frames_idx(p);
-    int table_length = program_get_num_of_frames(p);
+    int frame_number = frame_idx / frame_size;
+    int n_mappings = framemap_count(frame_number);
+    trace_instant("evict", "pager", -1, program_get_name(p), "frame", frame_number);
+    Program **unmapped = malloc(sizeof(Program *) * (n_mappings + 1));
+    if (unmapped == NULL) return 1;
+    int n_unmapped = 0;
+    Program *mapper;
+    int page_number;
 
-    if (program_update_page_table_entry(p, page_number, -1)) return 1;
-    program_dec_pages_stored(p);
+    while (framemap_pop(frame_number, &mapper, &page_number) == 0) {
+        cold_tier_store(mapper, page_number, frame_number);
+        if (program_update_page_table_entry(mapper, page_number, -1)) {
+            free(unmapped);
+            return 1;
+        }
+        program_dec_pages_stored(mapper);
+        int seen = 0;
+        for (int i = 0; i < n_unmapped; i++) {
+            if (unmapped[i] == mapper) seen = 1;  // a program can map the same shared frame from several pages
+        }
+        if (!seen) unmapped[n_unmapped++] = mapper;
+    }
     mem_free_frame(frame_idx);
+    for (int i = 0; i < n_unmapped; i++) {
+        program_reclaim_if_empty(unmapped[i]);
+    }
+    free(unmapped);
+    cold_tier_trim();  // only now, it may collect one of the unmapped programs
     return 0;
 }
 
 int evict_random_frame() {
-    int victim_idx  = ((rand() % FRAME_STORE_SIZE)/FRAME_SIZE)*FRAME_SIZE;
-    int victim_frame_num = victim_idx / FRAME_SIZE;
+    int victim_idx  = ((rand() % frame_store_size)/frame_size)*frame_size;
+    int victim_frame_num = victim_idx / frame_size;
     Program *victim_prog = find_victim_program(victim_frame_num);
     if (victim_prog == NULL) {
         printf("Warning: Couldn't evict frame in memory at idx=%d because it wasn't allocated\n", victim_idx);
@@ -76,9 +113,12 @@ int evict_random_frame() {
 }
 
 int evict_lru_frame() {
-    pthread_mutex_lock(&shellmemory_lock);
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
     int victim_frame_num = get_lru_and_reorder();
-    int victim_idx = victim_frame_num * FRAME_SIZE;
+    for (int i = 0; i < frame_store_num_of_frames() && !frame_is_page_start(victim_frame_num); i++) {
+        victim_frame_num = get_lru_and_reorder();  // free frames left over while a larger block was wanted
+    }
+    int victim_idx = victim_frame_num * frame_size;
     Program *victim_prog = find_victim_program(victim_frame_num);
     if (victim_prog == NULL) {
         printf("Warning: Couldn't evict frame in memory at idx=%d because it wasn't allocated\n", victim_idx);
@@ -93,17 +133,56 @@ int evict_lru_frame() {
     return 0;
 }
 
+int evict_reclaimable_frame() {
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
+    Program *victim_prog = program_oldest_reclaimable();
+    while (victim_prog != NULL && program_get_pages_stored(victim_prog) == 0) {  // only the cached image is left
+        victim_prog = program_next_reclaimable(victim_prog);
+    }
+    if (victim_prog == NULL) {
+        pthread_mutex_unlock(&shellmemory_lock);
+        return 1;
+    }
+    int *page_table = program_get_frames_idx(victim_prog);
+    int page_number = 0;
+    while (page_table[page_number] == -1) {
+        page_number++;
+    }
+    print_victim_lines(victim_prog, page_number);
+    int errorCode = evict_program_frame(victim_prog, page_table[page_number] * frame_size);
+    pthread_mutex_unlock(&shellmemory_lock);
+    return errorCode;
+}
+
+int evict_frame() {
+    if (reclaim_first && evict_reclaimable_frame() == 0) {
+        return 0;
+    }
+    return evict_lru_frame();
+}
+
 int print_victim_lines(Program *p, int page_num) {
-    int lines_idx = page_num * FRAME_SIZE;
-    const char *victim_name = program_get_name(p);
+    int page_size = program_get_page_size(p);
+    int lines_idx = page_num * page_size;
+    int line_length;
+    if (program_get_line(p, lines_idx, &line_length) != NULL) {  // served from the program's cached image
+        printf("Page fault! Victim page contents:\n\n");
+        for (int i = lines_idx; i < lines_idx + page_size; i++) {
+            const char *line = program_get_line(p, i, &line_length);
+            if (line == NULL) break;
+            printf("%.*s", line_length, line);
+        }
+        printf("\nEnd of victim page contents.\n");
+        return 0;
+    }
     char line[MAX_LINE_LENGTH];
-    FILE *f = fopen(victim_name, "r");
+    FILE *f = fopen(program_get_path(p), "r");
     if (f == NULL) return 1; 
     printf("Page fault! Victim page contents:\n\n");
     int curr_idx = 0;
     int lines_printed = 0;
     while (fgets(line, MAX_LINE_LENGTH, f) != NULL) {
-        if (lines_printed >= FRAME_SIZE) break;
+        if (lines_printed >= page_size) break;
         if (curr_idx >= lines_idx) {
             printf("%s", line);
             lines_printed++;
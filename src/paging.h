@@ -9,5 +9,7 @@ Program *find_victim_program(int frame_number);
 int evict_program_frame(Program *p, int frame_idx);
 int evict_random_frame();
 int evict_lru_frame();
+int evict_reclaimable_frame();
+int evict_frame();
 int print_victim_lines(Program *p, int page_num);
 #endif
\ No newline at end of file
@@ -5,17 +5,38 @@
 #include "program.h"
 #include <stdio.h>
 #include "config.h"
+#include <limits.h>
+#include "metrics.h"
+#include "trace.h"
 
 static pid_t pid_tracker = 1;
+static unsigned long age_ticks = 0;  // queued PCBs age one step per tick, see pcb_age_queued
 
 typedef struct PCB {
     pid_t pid;
     Program *program;
     int pc;
     int job_length_score;
+    int queued;
+    unsigned long age_base;  // tick the PCB entered the ready queue at
+    int level;             // MLFQ queue, 0 is the highest priority
+    unsigned level_epoch;  // boost epoch the level was set in, older levels count as 0
+    int nice;
+    unsigned long vruntime;  // instructions executed, scaled down by the nice weight
+    FairNode *fair_node;     // the PCB's node in the ready queue's FAIR tree, NULL when not in it
+    unsigned long relative_deadline;  // 0 when the script has no deadline
+    unsigned long deadline;           // absolute, on the EDF clock
+    Coroutine *coroutine;  // only set while the PCB is suspended mid-instruction (coroutine.c)
+    int worker;            // multithreaded worker that last ran the PCB, -1 before its first slice
+    ProcessTimes times;    // recorded when the PCB is destroyed after it ran (metrics.c)
+    unsigned long created_tick;  // instruction clock and wall time of creation and of the last time it became ready
+    long created_ns;
+    unsigned long ready_tick;
+    long ready_ns;
+    unsigned long blocked_tick;  // when it suspended on a child, while it is blocked
+    long blocked_ns;
+    long trace_start;      // trace time of the current slice's start
     PCB *next;
-    int *page_table;
-    int page_table_size;
     int backgroundModeOn;  // set to 1 if we are in background mode and pcb is a batch script, else 0
 } PCB;
 
@@ -25,11 +46,24 @@ PCB *pcb_create(Program *program) {
     pid_tracker++;
     pcb->program = program; 
     pcb->pc = 0;
-    pcb->job_length_score = program_get_length(program);
-    program_inc_pcb_pointing(program);
+    pcb->job_length_score = program_get_length(program);  // takes over the caller's reference to program
+    pcb->queued = 0;
+    pcb->age_base = 0;
+    pcb->level = 0;
+    pcb->level_epoch = 0;
+    pcb->nice = 0;
+    pcb->vruntime = 0;
+    pcb->fair_node = NULL;
+    pcb->relative_deadline = 0;
+    pcb->deadline = ULONG_MAX;
+    pcb->coroutine = NULL;
+    pcb->worker = -1;
+    pcb->times = (ProcessTimes){0};
+    pcb->times.pid = pcb->pid;
+    snprintf(pcb->times.name, sizeof(pcb->times.name), "%s", program_get_name(program));
+    pcb->created_tick = pcb->ready_tick = metrics_clock();
+    pcb->created_ns = pcb->ready_ns = metrics_now_ns();
     pcb->next = NULL;
-    pcb->page_table_size = program_get_num_of_frames(program);
-    pcb->page_table = program_get_frames_idx(program);
     
     pcb->backgroundModeOn = 0;
     return pcb;
@@ -38,20 +72,21 @@ PCB *pcb_create(Program *program) {
 
 
 int pcb_get_frame_number(PCB* pcb) {
-    if (pcb->page_table == NULL) {
+    int *page_table = program_get_frames_idx(pcb->program);  // a spooled program's page table grows, never cache it
+    if (page_table == NULL) {
         printf("Page table uninitialized for process: %s\n", program_get_name(pcb->program));
         exit(1);
     }
-    int page_number = pcb->pc/FRAME_SIZE;
-    if (pcb->page_table[page_number] == -1) {
+    int page_number = pcb->pc/program_get_page_size(pcb->program);
+    if (page_number >= program_get_num_of_frames(pcb->program) || page_table[page_number] == -1) {
         return -1;
     }
-    int page = pcb->page_table[page_number];
+    int page = page_table[page_number];
     return page;
 }
 
 int pcb_get_page_offset(PCB *pcb) { 
-    return pcb->pc%FRAME_SIZE;
+    return pcb->pc%program_get_page_size(pcb->program);
 }
 
 int pcb_get_physical_address(PCB *pcb) {
@@ -60,7 +95,7 @@ int pcb_get_physical_address(PCB *pcb) {
         return -1;
     }
     int offset = pcb_get_page_offset(pcb);
-    return frame_number*FRAME_SIZE + offset;
+    return frame_number*frame_size + offset;
 }
 
 void pcb_toggle_background_mode(PCB *pcb) { pcb->backgroundModeOn = !(pcb->backgroundModeOn); }
@@ -68,18 +103,14 @@ void pcb_toggle_background_mode(PCB *pcb) { pcb->backgroundModeOn = !(pcb->backg
 int pcb_get_background_mode(PCB *pcb) { return pcb->backgroundModeOn; }
 
 void pcb_destroy(PCB *pcb) {
-    int pcb_count = program_get_pcb_pointing(pcb->program);
-    program_dec_pcb_pointing(pcb->program);
-    /*
-    if (pcb_count == 1) {
-        if (program_destroy(pcb->program)) {
-            printf("Error: Another process using freed executable: %s\n", program_get_name(pcb->program));
-            exit(1);
-        }
-        
+    if (pcb == NULL) return;
+    if (pcb->times.dispatches > 0) {  // a PCB that ran is only destroyed once it completed
+        pcb->times.turnaround = metrics_clock() - pcb->created_tick;
+        pcb->times.turnaround_ns = metrics_now_ns() - pcb->created_ns;
+        metrics_record(&pcb->times);
     }
-    */
-    if (pcb != NULL) free(pcb);
+    program_release(pcb->program);  // the program's frames become reclaimable once no PCB uses it
+    free(pcb);
 }
 
 void pcb_increment_pc(PCB *pcb) { 
@@ -106,13 +137,132 @@ int pcb_get_program_size(PCB *pcb) {
     return program_get_length(pcb->program);
 }
 
-void pcb_decrement_job_length_score(PCB *pcb) {
-    if (pcb->job_length_score > 0) {
-        pcb->job_length_score--;
-    }
+// Ages every queued PCB by one in O(1): a queued score reads as its score at enqueue minus the
+// ticks since, floored at 0, which is the same as decrementing each one per tick
+void pcb_age_queued() {
+    age_ticks++;
+}
+
+void pcb_mark_queued(PCB *pcb) {
+    pcb->queued = 1;
+    pcb->age_base = age_ticks;
+}
+
+void pcb_mark_dequeued(PCB *pcb) {
+    pcb->job_length_score = pcb_get_job_length_score(pcb);  // settle the aging, it stops while running
+    pcb->queued = 0;
 }
 
 int pcb_get_job_length_score(PCB *pcb) {
-    return pcb->job_length_score;
+    if (!pcb->queued) return pcb->job_length_score;
+    unsigned long age = age_ticks - pcb->age_base;
+    return (age >= (unsigned long)pcb->job_length_score) ? 0 : pcb->job_length_score - (int)age;
+}
+
+int pcb_get_level(PCB *pcb, unsigned epoch) {
+    return (pcb->level_epoch == epoch) ? pcb->level : 0;
+}
+
+void pcb_set_level(PCB *pcb, int level, unsigned epoch) {
+    pcb->level = level;
+    pcb->level_epoch = epoch;
+}
+
+void pcb_set_options(PCB *pcb, const PCBOptions *options) {
+    if (options == NULL) return;
+    pcb->nice = options->nice;
+    pcb->relative_deadline = (options->deadline > 0) ? options->deadline : options->period;
+}
+
+int pcb_get_nice(PCB *pcb) {
+    return pcb->nice;
+}
+
+unsigned long pcb_get_vruntime(PCB *pcb) {
+    return pcb->vruntime;
+}
+
+void pcb_set_vruntime(PCB *pcb, unsigned long vruntime) {
+    pcb->vruntime = vruntime;
+}
+
+FairNode *pcb_get_fair_node(PCB *pcb) {
+    return pcb->fair_node;
+}
+
+void pcb_set_fair_node(PCB *pcb, FairNode *node) {
+    pcb->fair_node = node;
+}
+
+unsigned long pcb_get_relative_deadline(PCB *pcb) {
+    return pcb->relative_deadline;
+}
+
+unsigned long pcb_get_deadline(PCB *pcb) {
+    return pcb->deadline;
 }
 
+void pcb_set_deadline(PCB *pcb, unsigned long deadline) {
+    pcb->deadline = deadline;
+}
+
+Coroutine *pcb_get_coroutine(PCB *pcb) {
+    return pcb->coroutine;
+}
+
+void pcb_set_coroutine(PCB *pcb, Coroutine *coroutine) {
+    pcb->coroutine = coroutine;
+}
+
+int pcb_get_worker(PCB *pcb) {
+    return pcb->worker;
+}
+
+void pcb_set_worker(PCB *pcb, int worker) {
+    pcb->worker = worker;
+}
+
+// Taken off the ready queue to run, a PCB that AGING lets keep the CPU or that resumes a slice isn't dispatched again
+void pcb_mark_dispatched(PCB *pcb) {
+    unsigned long tick = metrics_clock();
+    long ns = metrics_now_ns();
+    if (pcb->times.dispatches == 0) {
+        pcb->times.response = tick - pcb->created_tick;
+        pcb->times.response_ns = ns - pcb->created_ns;
+    }
+    pcb->times.dispatches++;
+    pcb->times.wait += tick - pcb->ready_tick;
+    pcb->times.wait_ns += ns - pcb->ready_ns;
+}
+
+void pcb_mark_slice_started(PCB *pcb) {
+    pcb->trace_start = trace_now();
+}
+
+void pcb_mark_blocked(PCB *pcb) {  // suspended on a child mid-slice, off the CPU but not ready
+    pcb->blocked_tick = metrics_clock();
+    pcb->blocked_ns = metrics_now_ns();
+}
+
+void pcb_mark_unblocked(PCB *pcb) {  // the child exited, the PCB is ready again
+    pcb->ready_tick = metrics_clock();
+    pcb->ready_ns = metrics_now_ns();
+    pcb->times.blocked += pcb->ready_tick - pcb->blocked_tick;
+    pcb->times.blocked_ns += pcb->ready_ns - pcb->blocked_ns;
+}
+
+void pcb_mark_preempted(PCB *pcb, int instructions) {  // the slice is over, the PCB is ready again unless it completed
+    metrics_clock_advance(instructions);
+    trace_span("slice", "sched", pcb->trace_start, pcb->pid, pcb->times.name, "instructions", instructions);
+    pcb->times.instructions += instructions;
+    pcb->ready_tick = metrics_clock();
+    pcb->ready_ns = metrics_now_ns();
+}
+
+void pcb_count_fault(PCB *pcb) {
+    pcb->times.faults++;
+}
+
+int pcb_get_pid(PCB *pcb) {
+    return pcb->pid;
+}
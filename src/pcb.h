@@ -4,6 +4,15 @@
 #include <sys/types.h>
 typedef struct Program Program;
 typedef struct PCB PCB;
+typedef struct FairNode FairNode;
+typedef struct Coroutine Coroutine;
+
+typedef struct PCBOptions {  // per-script settings given on exec as script@key=value
+    int nice;
+    int deadline;  // instructions from exec the script must finish within, 0 for none
+    int period;    // scripts run once, so a period is an implicit deadline
+} PCBOptions;
+
 PCB *pcb_create(Program *program);
 void pcb_toggle_background_mode(PCB *pcb);
 int pcb_get_background_mode(PCB *pcb);
@@ -15,8 +24,32 @@ PCB *pcb_get_next(PCB *pcb);
 int pcb_get_pc(PCB *pcb);
 Program *pcb_get_program(PCB *pcb);
 int pcb_get_program_size(PCB *pcb);
-void pcb_decrement_job_length_score(PCB *pcb);
+void pcb_age_queued();
+void pcb_mark_queued(PCB *pcb);
+void pcb_mark_dequeued(PCB *pcb);
 int pcb_get_job_length_score(PCB *pcb);
+int pcb_get_level(PCB *pcb, unsigned epoch);
+void pcb_set_level(PCB *pcb, int level, unsigned epoch);
+void pcb_set_options(PCB *pcb, const PCBOptions *options);
+int pcb_get_nice(PCB *pcb);
+unsigned long pcb_get_vruntime(PCB *pcb);
+void pcb_set_vruntime(PCB *pcb, unsigned long vruntime);
+FairNode *pcb_get_fair_node(PCB *pcb);
+void pcb_set_fair_node(PCB *pcb, FairNode *node);
+unsigned long pcb_get_relative_deadline(PCB *pcb);
+unsigned long pcb_get_deadline(PCB *pcb);
+void pcb_set_deadline(PCB *pcb, unsigned long deadline);
+Coroutine *pcb_get_coroutine(PCB *pcb);
+void pcb_set_coroutine(PCB *pcb, Coroutine *coroutine);
+int pcb_get_worker(PCB *pcb);
+void pcb_set_worker(PCB *pcb, int worker);
+void pcb_mark_dispatched(PCB *pcb);
+void pcb_mark_slice_started(PCB *pcb);
+void pcb_mark_blocked(PCB *pcb);
+void pcb_mark_unblocked(PCB *pcb);
+void pcb_mark_preempted(PCB *pcb, int instructions);
+void pcb_count_fault(PCB *pcb);
+int pcb_get_pid(PCB *pcb);
 
 int pcb_get_frame_number(PCB* pcb);
 int pcb_get_page_offset(PCB *pcb);
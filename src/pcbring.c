@@ -0,0 +1,98 @@
+#include "pcbring.h"
+#include <stdlib.h>
+
+// Bounded lock-free MPMC FIFO of PCBs (Vyukov's ring). Each cell's sequence number tells whose
+// turn it is: pos when a producer at pos may fill it, pos + 1 once it holds a PCB for the consumer
+// at pos, so producers and consumers only ever contend on their own position counter.
+
+typedef struct Cell {
+    unsigned long sequence;
+    PCB *pcb;
+} Cell;
+
+struct PCBRing {
+    Cell *cells;
+    unsigned long mask;
+    char pad0[64];  // keeps the two positions on separate cache lines
+    unsigned long enqueue_pos;
+    char pad1[64];
+    unsigned long dequeue_pos;
+    char pad2[64];
+};
+
+PCBRing *pcb_ring_create(int capacity) {
+    unsigned long size = 2;
+    while (size < (unsigned long)capacity) size *= 2;
+    PCBRing *ring = malloc(sizeof(PCBRing));
+    if (ring == NULL) return NULL;
+    ring->cells = malloc(sizeof(Cell) * size);
+    if (ring->cells == NULL) {
+        free(ring);
+        return NULL;
+    }
+    for (unsigned long i = 0; i < size; i++) {
+        ring->cells[i].sequence = i;
+        ring->cells[i].pcb = NULL;
+    }
+    ring->mask = size - 1;
+    ring->enqueue_pos = 0;
+    ring->dequeue_pos = 0;
+    return ring;
+}
+
+void pcb_ring_destroy(PCBRing *ring) {
+    if (ring == NULL) return;
+    free(ring->cells);
+    free(ring);
+}
+
+int pcb_ring_capacity(PCBRing *ring) {
+    return ring->mask + 1;
+}
+
+int pcb_ring_size(PCBRing *ring) {  // approximate while a push or pop is under way
+    long size = (long)(__atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED) - __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED));
+    return (size < 0) ? 0 : size;
+}
+
+int pcb_ring_push(PCBRing *ring, PCB *pcb) {  // 1 when full
+    unsigned long pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    Cell *cell;
+    while (1) {
+        cell = &ring->cells[pos & ring->mask];
+        long diff = (long)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (long)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        }
+        else if (diff < 0) {
+            return 1;  // the consumer a lap behind hasn't emptied the cell yet
+        }
+        else {
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    cell->pcb = pcb;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+PCB *pcb_ring_pop(PCBRing *ring) {  // NULL when empty
+    unsigned long pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    Cell *cell;
+    while (1) {
+        cell = &ring->cells[pos & ring->mask];
+        long diff = (long)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (long)(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        }
+        else if (diff < 0) {
+            return NULL;  // no producer has filled this cell yet
+        }
+        else {
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    PCB *pcb = cell->pcb;
+    __atomic_store_n(&cell->sequence, pos + ring->mask + 1, __ATOMIC_RELEASE);  // free for the producer one lap ahead
+    return pcb;
+}
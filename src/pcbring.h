@@ -0,0 +1,11 @@
+#ifndef PCBRING_H
+#define PCBRING_H
+#include "pcb.h"
+typedef struct PCBRing PCBRing;
+PCBRing *pcb_ring_create(int capacity);
+void pcb_ring_destroy(PCBRing *ring);
+int pcb_ring_capacity(PCBRing *ring);
+int pcb_ring_size(PCBRing *ring);
+int pcb_ring_push(PCBRing *ring, PCB *pcb);
+PCB *pcb_ring_pop(PCBRing *ring);
+#endif
@@ -1,9 +1,52 @@
 #include "policies.h"
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <stdio.h>
+#include "config.h"
+#include "fairtree.h"
+
+static unsigned mlfq_boost_epoch = 0;    // every PCB is back at the top level when this moves
+static unsigned long mlfq_instructions = 0;
+static unsigned long edf_clock = 0;  // instructions executed under EDF, deadlines are ticks of this clock
+static unsigned long edf_met = 0;
+static unsigned long edf_missed = 0;
+static unsigned long edf_rejected = 0;
+static unsigned long edf_max_lateness = 0;
+static int edf_used = 0;  // stats only reports EDF once a script was admitted under it
+
+// RR:<n> is a quantum of n instructions, RR:<n>ms or RR:<n>us a quantum of elapsed time
+static int parse_rr_quantum(const char *quantum, Policy *policy) {
+    char *unit;
+    long value = strtol(quantum, &unit, 10);
+    if (unit == quantum || value <= 0) return 1;
+    if (*unit == '\0') {
+        if (value > INT_MAX) return 1;  // job_length is an int, and -1 would mean no preemption
+        policy->job_length = value;
+        return 0;
+    }
+    if (strcmp(unit, "ms") == 0 && value <= LONG_MAX / 1000000L) policy->time_slice_ns = value * 1000000L;
+    else if (strcmp(unit, "us") == 0 && value <= LONG_MAX / 1000L) policy->time_slice_ns = value * 1000L;
+    else return 1;
+    policy->job_length = -1;
+
+    // the coarse clock is a vDSO read without a syscall, only good enough when the slice spans a few of its ticks
+    struct timespec resolution;
+    policy->clock_id = CLOCK_MONOTONIC;
+    if (clock_getres(CLOCK_MONOTONIC_COARSE, &resolution) == 0 && resolution.tv_sec == 0 &&
+        resolution.tv_nsec * 4 <= policy->time_slice_ns) {
+        policy->clock_id = CLOCK_MONOTONIC_COARSE;
+    }
+    return 0;
+}
 
 Policy *parse_policy(const char *policy_string) {
     Policy *new_policy = malloc(sizeof(Policy));
+    new_policy->get_metric_function = NULL;
+    new_policy->get_time_slice_function = NULL;
+    new_policy->slice_done_function = NULL;
+    new_policy->admit_function = NULL;
+    new_policy->time_slice_ns = 0;
     if (strcmp(policy_string, "FCFS") == 0) {
         new_policy->job_length = -1;
         new_policy->enqueue_function = fcfs_enqueue;
@@ -26,6 +69,33 @@ Policy *parse_policy(const char *policy_string) {
         new_policy->job_length = 30;
         new_policy->enqueue_function = fcfs_enqueue;
     } 
+    else if (strncmp(policy_string, "RR:", 3) == 0) {
+        if (parse_rr_quantum(policy_string + 3, new_policy)) {
+            free(new_policy);
+            return NULL;
+        }
+        new_policy->enqueue_function = fcfs_enqueue;
+    } 
+    else if (strcmp(policy_string, "FAIR") == 0) {
+        new_policy->job_length = FAIR_BASE_SLICE;
+        new_policy->enqueue_function = fair_enqueue;
+        new_policy->get_time_slice_function = fair_get_time_slice;
+        new_policy->slice_done_function = fair_slice_done;
+    } 
+    else if (strcmp(policy_string, "MLFQ") == 0) {
+        new_policy->job_length = MLFQ_BASE_QUANTUM;
+        new_policy->enqueue_function = sjf_enqueue;  // sorted by level, FIFO within a level
+        new_policy->get_metric_function = mlfq_get_level;
+        new_policy->get_time_slice_function = mlfq_get_time_slice;
+        new_policy->slice_done_function = mlfq_slice_done;
+    } 
+    else if (strcmp(policy_string, "EDF") == 0) {
+        new_policy->job_length = EDF_SLICE;
+        new_policy->enqueue_function = sjf_enqueue;  // sorted by absolute deadline, scripts without one go last
+        new_policy->get_metric_function = edf_get_deadline;
+        new_policy->slice_done_function = edf_slice_done;
+        new_policy->admit_function = edf_admit;
+    } 
     else {
         free(new_policy);
         return NULL;
@@ -69,12 +139,171 @@ int sjf_enqueue(PCB *pcb, ReadyQueue *queue, Policy *policy) {       // FOR SJF
     return 0;
 }
 
-void age_queue(ReadyQueue *queue) {
+int policy_slice_expired(Policy *policy, const struct timespec *slice_start) {
+    struct timespec now;
+    clock_gettime(policy->clock_id, &now);
+    long elapsed = (now.tv_sec - slice_start->tv_sec) * 1000000000L + (now.tv_nsec - slice_start->tv_nsec);
+    return elapsed >= policy->time_slice_ns;
+}
+
+int policy_get_time_slice(Policy *policy, PCB *pcb) {
+    if (policy->get_time_slice_function == NULL) return policy->job_length;
+    return policy->get_time_slice_function(pcb);
+}
+
+int policy_same(Policy *a, Policy *b) {  // whether PCBs queued under a can be scheduled by b
+    return a->enqueue_function == b->enqueue_function && a->get_metric_function == b->get_metric_function &&
+           a->get_time_slice_function == b->get_time_slice_function && a->job_length == b->job_length &&
+           a->time_slice_ns == b->time_slice_ns && (a->time_slice_ns == 0 || a->clock_id == b->clock_id);
+}
+
+int mlfq_get_level(PCB *pcb) {
+    return pcb_get_level(pcb, __atomic_load_n(&mlfq_boost_epoch, __ATOMIC_RELAXED));
+}
+
+int mlfq_get_time_slice(PCB *pcb) {
+    return MLFQ_BASE_QUANTUM << mlfq_get_level(pcb);  // quanta double at each level down
+}
+
+// A PCB that used its whole slice drops a level, one that gave up the CPU early (page fault) keeps it.
+// Every MLFQ_BOOST_PERIOD instructions all PCBs go back to the top level so long scripts don't starve.
+void mlfq_slice_done(PCB *pcb, int lines_executed) {
+    int level = mlfq_get_level(pcb);
+    unsigned long before = __atomic_fetch_add(&mlfq_instructions, lines_executed, __ATOMIC_RELAXED);
+    if ((before + lines_executed) / MLFQ_BOOST_PERIOD != before / MLFQ_BOOST_PERIOD) {
+        __atomic_add_fetch(&mlfq_boost_epoch, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (lines_executed >= (MLFQ_BASE_QUANTUM << level) && level < MLFQ_LEVELS - 1) {
+        level++;
+    }
+    pcb_set_level(pcb, level, __atomic_load_n(&mlfq_boost_epoch, __ATOMIC_RELAXED));
+}
+
+// CFS load weights for nice -20..19, each step is about 10% of CPU
+static const int nice_to_weight[40] = {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+    9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+    1024,  820,   655,   526,   423,   335,   272,   215,   172,   137,
+    110,   87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+
+static int fair_weight(PCB *pcb) {
+    return nice_to_weight[pcb_get_nice(pcb) + 20];
+}
+
+int fair_get_time_slice(PCB *pcb) {
+    int slice = FAIR_BASE_SLICE * fair_weight(pcb) / nice_to_weight[20];
+    return (slice < 1) ? 1 : slice;
+}
+
+void fair_slice_done(PCB *pcb, int lines_executed) {
+    unsigned long delta = (unsigned long)lines_executed * nice_to_weight[20] * 1024 / fair_weight(pcb);
+    pcb_set_vruntime(pcb, pcb_get_vruntime(pcb) + delta);  // vruntime counts in 1/1024 instructions
+}
+
+// Inserts the PCB in the vruntime tree and splices it into the list after its tree predecessor,
+// so dequeuing the head still takes the minimum in O(log n)
+int fair_enqueue(PCB *pcb, ReadyQueue *queue, Policy *policy) {
+    (void)policy;  // the signature every enqueue_function shares
+    if (pcb_get_vruntime(pcb) < queue->min_vruntime) {
+        pcb_set_vruntime(pcb, queue->min_vruntime);  // a new or long-waiting PCB doesn't get to monopolize the CPU
+    }
+    FairNode *predecessor;
+    FairNode *node = fair_tree_insert(&queue->fair_root, pcb, pcb_get_vruntime(pcb), &predecessor);
+    if (node == NULL) return 1;
+    pcb_set_fair_node(pcb, node);
+
+    if (predecessor != NULL) {
+        PCB *prev = predecessor->pcb;
+        pcb_set_next(pcb, pcb_get_next(prev));
+        pcb_set_next(prev, pcb);
+        if (queue->tail == prev) queue->tail = pcb;
+        return 0;
+    }
+    PCB *prev = NULL;  // new minimum: it goes before every FAIR PCB, after any batch script put at the head
     PCB *curr = queue->head;
-    while (curr != NULL) {
-        pcb_decrement_job_length_score(curr);
+    while (curr != NULL && pcb_get_fair_node(curr) == NULL) {
+        prev = curr;
         curr = pcb_get_next(curr);
     }
+    pcb_set_next(pcb, curr);
+    if (prev == NULL) queue->head = pcb;
+    else pcb_set_next(prev, pcb);
+    if (curr == NULL) queue->tail = pcb;
+    return 0;
+}
+
+int edf_get_deadline(PCB *pcb) {
+    unsigned long deadline = pcb_get_deadline(pcb);
+    return (deadline > INT_MAX) ? INT_MAX : (int)deadline;
+}
+
+static unsigned long remaining_work(PCB *pcb) {
+    return pcb_get_program_size(pcb) - pcb_get_pc(pcb);
+}
+
+static int edf_reject() {
+    __atomic_add_fetch(&edf_rejected, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// Sets the PCB's absolute deadline and admits it only if, with its work added, every queued job
+// due at or after it can still finish in time on one CPU (the EDF demand test over the sorted queue).
+// The job on the CPU isn't in the queue, so the test ignores what it has left.
+int edf_admit(PCB *pcb, ReadyQueue *queue) {
+    __atomic_store_n(&edf_used, 1, __ATOMIC_RELAXED);
+    unsigned long relative = pcb_get_relative_deadline(pcb);
+    if (relative == 0) return 0;  // best effort, runs after every deadline
+    unsigned long now = __atomic_load_n(&edf_clock, __ATOMIC_RELAXED);
+    unsigned long work = remaining_work(pcb);
+    unsigned long demand = 0;  // queued work due up to the current deadline
+    int placed = 0;
+
+    for (PCB *curr = queue->head; curr != NULL; curr = pcb_get_next(curr)) {
+        unsigned long deadline = pcb_get_deadline(curr);
+        if (deadline == ULONG_MAX) continue;
+        if (!placed && deadline > now + relative) {
+            if (demand + work > relative) return edf_reject();
+            placed = 1;
+        }
+        demand += remaining_work(curr);
+        if (placed && deadline > now && demand + work > deadline - now && demand <= deadline - now) {
+            return edf_reject();  // that job would have made it without the newcomer
+        }
+    }
+    if (!placed && demand + work > relative) return edf_reject();
+    pcb_set_deadline(pcb, now + relative);
+    return 0;
+}
+
+void edf_slice_done(PCB *pcb, int lines_executed) {
+    unsigned long now = __atomic_add_fetch(&edf_clock, lines_executed, __ATOMIC_RELAXED);
+    unsigned long deadline = pcb_get_deadline(pcb);
+    if (deadline == ULONG_MAX || !process_completed(pcb)) return;
+    if (now <= deadline) {
+        __atomic_add_fetch(&edf_met, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_add_fetch(&edf_missed, 1, __ATOMIC_RELAXED);
+    unsigned long lateness = now - deadline;
+    unsigned long max = __atomic_load_n(&edf_max_lateness, __ATOMIC_RELAXED);
+    while (lateness > max &&
+           !__atomic_compare_exchange_n(&edf_max_lateness, &max, lateness, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void edf_print_stats() {
+    if (!__atomic_load_n(&edf_used, __ATOMIC_RELAXED)) return;
+    printf("EDF: clock %lu, met %lu, missed %lu, rejected %lu, max lateness %lu\n",
+           __atomic_load_n(&edf_clock, __ATOMIC_RELAXED), __atomic_load_n(&edf_met, __ATOMIC_RELAXED),
+           __atomic_load_n(&edf_missed, __ATOMIC_RELAXED), __atomic_load_n(&edf_rejected, __ATOMIC_RELAXED),
+           __atomic_load_n(&edf_max_lateness, __ATOMIC_RELAXED));
+}
+
+void age_queue(ReadyQueue *queue) {
+    (void)queue;  // epoch aging touches no queued PCB
+    pcb_age_queued();  // multithreaded callers hold ready_queue_lock
 }
 
 int aging_and_score_is_smallest(PCB *pcb, ReadyQueue *queue, Policy *policy) {
@@ -2,17 +2,36 @@
 #define ENQUEUE_FUNCTIONS_H
 #include "pcb.h"
 #include "readyqueue.h"
+#include <time.h>
 
 typedef struct Policy {
     int job_length;  // -1 indicates non preemptive
     int (*enqueue_function)(PCB *pcb, ReadyQueue *queue, struct Policy *policy);
     int (*get_metric_function)(PCB *pcb);  // function p* to select a comparison metric for sjf_enqueue
                                            //  (aging/non-aging = program_size/job_length_score)
+    int (*get_time_slice_function)(PCB *pcb);                   // per-PCB slice, NULL means job_length
+    void (*slice_done_function)(PCB *pcb, int lines_executed);  // feedback once a PCB leaves the CPU, may be NULL
+    int (*admit_function)(PCB *pcb, ReadyQueue *queue);         // admission check before the first enqueue, may be NULL
+    long time_slice_ns;  // > 0 preempts on elapsed time instead of instruction count
+    clockid_t clock_id;
 } Policy;
 
 Policy *parse_policy(const char *policy_string);
 int fcfs_enqueue(PCB *pcb, ReadyQueue *queue, Policy *policy);
 int sjf_enqueue(PCB *pcb, ReadyQueue *queue, Policy *policy);
+int fair_enqueue(PCB *pcb, ReadyQueue *queue, Policy *policy);
+int fair_get_time_slice(PCB *pcb);
+void fair_slice_done(PCB *pcb, int lines_executed);
 void age_queue(ReadyQueue *queue);
+int policy_slice_expired(Policy *policy, const struct timespec *slice_start);
+int policy_get_time_slice(Policy *policy, PCB *pcb);
+int policy_same(Policy *a, Policy *b);
+int mlfq_get_level(PCB *pcb);
+int mlfq_get_time_slice(PCB *pcb);
+void mlfq_slice_done(PCB *pcb, int lines_executed);
+int edf_get_deadline(PCB *pcb);
+int edf_admit(PCB *pcb, ReadyQueue *queue);
+void edf_slice_done(PCB *pcb, int lines_executed);
+void edf_print_stats();
 int aging_and_score_is_smallest(PCB *pcb, ReadyQueue *queue, Policy *policy);
 #endif
@@ -4,38 +4,509 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "config.h"
+#include "diskcache.h"
 #include <pthread.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "helper.h"
 #include "lru.h"
 #include "paging.h"
+#include "buddy.h"
+#include "framemap.h"
+#include "coldtier.h"
+#include "epoch.h"
+#include "trace.h"
 
 extern pthread_mutex_t shellmemory_lock;
 
-Program *program_table[MAX_PROGRAM];
-int program_table_size = 0;
-
 typedef struct Program {
     char *name;
+    char *path;      // canonical path used for file access, NULL for background programs
+    dev_t dev;       // dev/inode identify the script regardless of the name it was exec'd with
+    ino_t ino;
+    unsigned long hash;
+    Program *hash_next;
+    Program *table_prev;  // every program is also linked in insertion order for iteration
+    Program *table_next;
+    Program *reclaim_prev;  // programs no PCB points to anymore, least recently finished first
+    Program *reclaim_next;
+    int reclaimable;
+    int stale;            // the script changed on disk, running PCBs finish on the old image
+    struct timespec mtime;
+    off_t size;
+    char *text;           // cached image of the script, NULL once dropped from the cache
+    int *line_offsets;    // line i is text[line_offsets[i]] up to line_offsets[i+1]
+    void *image_map;      // set when the image is mapped from the on-disk cache or a spool
+    size_t image_map_length;
+    int streaming;        // background program still spooling lines from its input
+    FILE *spool_source;
+    int spool_fd;         // unlinked file backing the spooled text, -1 for scripts
+    size_t spool_mapped;
+    size_t text_length;
+    int line_capacity;
+    int page_capacity;
+    size_t image_bytes;
     int pcb_pointing;
-    int table_idx;
+    int page_order;       // a page spans 2^page_order frames
     int num_of_frames;
     int *frames_idx;
     int length;
     int pages_stored;
+    int cold_pages;       // evicted pages held compressed in the cold tier
+    pthread_mutex_t table_lock;  // page table writers hold it and shellmemory_lock, readers either one
 } Program;
 
-Program *program_create(char *name) {
+// The hash buckets are read without a lock by program_acquire's fast path: chains are published with
+// release stores, and removed programs and replaced bucket arrays are freed through epoch.c
+typedef struct ProgramBuckets {
+    int count;
+    Program *heads[];
+} ProgramBuckets;
+
+static ProgramBuckets *program_buckets = NULL;
+static int program_table_size = 0;
+static Program *program_table_head = NULL;
+static Program *program_table_tail = NULL;
+static Program *reclaimable_head = NULL;
+static Program *reclaimable_tail = NULL;
+static size_t reclaimable_image_bytes = 0;
+static Program *stdin_spool = NULL;  // batch program that stdin currently belongs to
+
+static void unlink_reclaimable(Program *p);
+static Program *lookup_program(char *name, struct stat *st);
+static int unhash_prog(Program *p);
+
+static unsigned long hash_bytes(unsigned long hash, const void *data, size_t size) {  // FNV-1a
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static unsigned long hash_file_key(dev_t dev, ino_t ino) {
+    unsigned long hash = hash_bytes(14695981039346656037UL, &dev, sizeof(dev));
+    return hash_bytes(hash, &ino, sizeof(ino));
+}
+
+static unsigned long hash_name_key(const char *name) {
+    return hash_bytes(14695981039346656037UL, name, strlen(name));
+}
+
+static int program_matches_key(Program *p, unsigned long hash, int is_file, dev_t dev, ino_t ino, const char *name) {
+    if (p->hash != hash) return 0;
+    if (is_file) return p->path != NULL && p->dev == dev && p->ino == ino;
+    return p->path == NULL && strcmp(p->name, name) == 0;
+}
+
+// Rehashing relinks live programs in place, a reader caught in the middle may miss a program but
+// never loops or sees freed memory, and a miss only sends program_acquire down the locked path
+static int program_table_grow() {
+    int new_count = (program_buckets == NULL) ? 64 : program_buckets->count * 2;
+    ProgramBuckets *new_buckets = calloc(1, sizeof(ProgramBuckets) + sizeof(Program *) * new_count);
+    if (new_buckets == NULL) return 1;
+    new_buckets->count = new_count;
+
+    for (Program *p = program_table_head; p != NULL; p = p->table_next) {
+        if (p->stale) continue;  // unhashed already
+        int bucket = p->hash % new_count;
+        __atomic_store_n(&p->hash_next, new_buckets->heads[bucket], __ATOMIC_RELEASE);
+        new_buckets->heads[bucket] = p;
+    }
+    ProgramBuckets *old_buckets = program_buckets;
+    __atomic_store_n(&program_buckets, new_buckets, __ATOMIC_RELEASE);
+    if (old_buckets != NULL) epoch_retire(old_buckets, free);
+    return 0;
+}
+
+static int insert_prog_in_table(Program *p) {
+    if (program_buckets == NULL || program_table_size + 1 > program_buckets->count * 3 / 4) {
+        if (program_table_grow()) return 1;
+    }
+    int bucket = p->hash % program_buckets->count;
+    p->hash_next = program_buckets->heads[bucket];
+    __atomic_store_n(&program_buckets->heads[bucket], p, __ATOMIC_RELEASE);
+
+    p->table_prev = program_table_tail;
+    p->table_next = NULL;
+    if (program_table_tail != NULL) program_table_tail->table_next = p;
+    else program_table_head = p;
+    program_table_tail = p;
+    program_table_size++;
+    return 0;
+}
+
+static Program *program_alloc(char *name, int is_file) {
     Program* p = malloc(sizeof(Program));
+    if (p == NULL) return NULL;
     p->name = strdup(name); 
-    p->pcb_pointing = 0;
-    program_table[program_table_size] = p;
-    p->table_idx = program_table_size;
-    program_table_size++;
+    p->path = NULL;
+    p->dev = 0;
+    p->ino = 0;
+
+    struct stat st;
+    char resolved[PATH_MAX];
+    if (is_file && stat(name, &st) == 0 && realpath(name, resolved) != NULL) {
+        p->path = strdup(resolved);
+        p->dev = st.st_dev;
+        p->ino = st.st_ino;
+        p->hash = hash_file_key(st.st_dev, st.st_ino);
+    }
+    else {  // background programs have no backing file, they are keyed by name only
+        p->hash = hash_name_key(name);
+    }
+    p->reclaim_prev = NULL;
+    p->reclaim_next = NULL;
+    p->reclaimable = 0;
+    p->stale = 0;
+    p->mtime.tv_sec = 0;
+    p->mtime.tv_nsec = 0;
+    p->size = 0;
+    p->text = NULL;
+    p->line_offsets = NULL;
+    p->image_map = NULL;
+    p->image_map_length = 0;
+    p->streaming = 0;
+    p->spool_source = NULL;
+    p->spool_fd = -1;
+    p->spool_mapped = 0;
+    p->text_length = 0;
+    p->line_capacity = 0;
+    p->page_capacity = 0;
+    p->image_bytes = 0;
+    p->pcb_pointing = 1;  // the creator's reference, handed over to the first PCB
+    p->page_order = 0;
+    p->num_of_frames = 0;
+    p->frames_idx = NULL;
     p->length = 0;
     p->pages_stored = 0;
+    p->cold_pages = 0;
+    pthread_mutex_init(&p->table_lock, NULL);
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
+    int errorCode = insert_prog_in_table(p);
+    pthread_mutex_unlock(&shellmemory_lock);
+    if (errorCode) {
+        pthread_mutex_destroy(&p->table_lock);
+        free(p->path);
+        free(p->name);
+        free(p);
+        return NULL;
+    }
     return p; 
 }
-int load_page_into_frame_store(Program * p, char** lines, int page_number) {
+
+Program *program_create(char *name) {
+    return program_alloc(name, 1);
+}
+
+Program *background_program_create(char *name) {
+    return program_alloc(name, 0);
+}
+
+// A script image read without touching its Program, published to it under shellmemory_lock
+typedef struct ProgramImage {
+    char *text;
+    int *line_offsets;
+    int length;
+    size_t image_bytes;
+    void *map;  // set when mapped from the on-disk cache
+    size_t map_length;
+    struct stat st;
+} ProgramImage;
+
+static int index_image_lines(ProgramImage *image, size_t text_length) {
+    // lines are split the same way fgets(line, MAX_LINE_LENGTH, f) would split them
+    int capacity = 16;
+    int count = 0;
+    int *offsets = malloc(sizeof(int) * capacity);
+    if (offsets == NULL) return 1;
+
+    size_t pos = 0;
+    while (pos < text_length) {
+        if (count + 2 > capacity) {
+            capacity *= 2;
+            int *tmp = realloc(offsets, sizeof(int) * capacity);
+            if (tmp == NULL) {
+                free(offsets);
+                return 1;
+            }
+            offsets = tmp;
+        }
+        offsets[count++] = pos;
+        size_t line_length = 0;
+        while (pos < text_length && line_length < MAX_LINE_LENGTH - 1) {
+            line_length++;
+            if (image->text[pos++] == '\n') break;
+        }
+    }
+    offsets[count] = pos;
+    image->line_offsets = offsets;
+    image->length = count;
+    image->image_bytes = text_length + 1 + sizeof(int) * (count + 1);
+    return 0;
+}
+
+static void program_free_image(Program *p) {
+    if (p->spool_fd != -1) {
+        munmap(p->image_map, p->image_map_length);
+        close(p->spool_fd);
+        free(p->line_offsets);
+        p->spool_fd = -1;
+    }
+    else if (p->image_map != NULL) {
+        disk_cache_unmap(p->image_map, p->image_map_length);
+    }
+    else {
+        free(p->text);
+        free(p->line_offsets);
+    }
+    p->image_map = NULL;
+    p->image_map_length = 0;
+    p->text = NULL;
+    p->line_offsets = NULL;
+}
+
+static void set_image_stat(Program *p, struct stat *st) {  // read by acquire_running_program without a lock
+    __atomic_store_n(&p->mtime.tv_sec, st->st_mtim.tv_sec, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->mtime.tv_nsec, st->st_mtim.tv_nsec, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->size, st->st_size, __ATOMIC_RELAXED);
+}
+
+static void free_image(ProgramImage *image) {
+    if (image->map != NULL) {
+        disk_cache_unmap(image->map, image->map_length);
+    }
+    else {
+        free(image->text);
+        free(image->line_offsets);
+    }
+}
+
+// Reads and indexes the script at path, touches no shared state but the on-disk cache
+static int read_image(const char *path, ProgramImage *image) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return 1;
+    }
+    if (fstat(fileno(f), &image->st) != 0) {
+        fclose(f);
+        return 1;
+    }
+
+    DiskImage cached;
+    if (disk_cache_map(&image->st, &cached) == 0) {  // compiled copy left by an earlier shell, no parsing needed
+        fclose(f);
+        image->map = cached.map;
+        image->map_length = cached.map_length;
+        image->text = cached.text;
+        image->line_offsets = cached.line_offsets;
+        image->length = cached.line_count;
+        image->image_bytes = cached.map_length;
+        return 0;
+    }
+
+    image->map = NULL;
+    image->map_length = 0;
+    image->text = malloc(image->st.st_size + 1);
+    if (image->text == NULL) {
+        fclose(f);
+        return 1;
+    }
+    size_t text_length = fread(image->text, 1, image->st.st_size, f);
+    fclose(f);
+    image->text[text_length] = '\0';
+
+    if (index_image_lines(image, text_length)) {
+        free(image->text);
+        return 1;
+    }
+    if (text_length == (size_t)image->st.st_size) {
+        disk_cache_store(&image->st, image->text, text_length, image->line_offsets, image->length);
+    }
+    return 0;
+}
+
+static void install_image(Program *p, ProgramImage *image) {
+    program_free_image(p);
+    p->image_map = image->map;
+    p->image_map_length = image->map_length;
+    p->text = image->text;
+    p->line_offsets = image->line_offsets;
+    p->length = image->length;
+    p->image_bytes = image->image_bytes;
+    set_image_stat(p, &image->st);
+}
+
+int program_read_image(Program *p) {
+    ProgramImage image;
+    if (read_image(program_get_path(p), &image)) return 1;
+    install_image(p, &image);
+    return 0;
+}
+
+int background_program_open_spool(Program *p, FILE *source) {
+    const char *tmp_dir = getenv("TMPDIR");
+    char spool_path[PATH_MAX];
+    snprintf(spool_path, sizeof(spool_path), "%s/mysh-spool-XXXXXX", (tmp_dir != NULL) ? tmp_dir : "/tmp");
+    int fd = mkstemp(spool_path);
+    if (fd == -1) return 1;
+    unlink(spool_path);  // the spool only lives as long as the program
+
+    // reserve the address space once so lines never move while the spool grows
+    void *reserve = mmap(NULL, SPOOL_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserve == MAP_FAILED) {
+        close(fd);
+        return 1;
+    }
+    p->line_capacity = 64;
+    p->line_offsets = malloc(sizeof(int) * p->line_capacity);
+    if (p->line_offsets == NULL || program_init_page_table(p)) {
+        free(p->line_offsets);
+        p->line_offsets = NULL;
+        munmap(reserve, SPOOL_RESERVE);
+        close(fd);
+        return 1;
+    }
+    p->line_offsets[0] = 0;
+    p->text = reserve;
+    p->image_map = reserve;
+    p->image_map_length = SPOOL_RESERVE;
+    p->spool_fd = fd;
+    p->spool_source = source;
+    p->streaming = 1;
+    if (source == stdin) __atomic_store_n(&stdin_spool, p, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void end_spool(Program *p) {
+    p->streaming = 0;
+    if (__atomic_load_n(&stdin_spool, __ATOMIC_ACQUIRE) == p) __atomic_store_n(&stdin_spool, NULL, __ATOMIC_RELEASE);
+}
+
+static int spool_append(Program *p, const char *line, size_t line_length) {
+    if (p->text_length + line_length > p->spool_mapped) {
+        size_t new_mapped = p->spool_mapped + SPOOL_CHUNK;
+        if (new_mapped > SPOOL_RESERVE || ftruncate(p->spool_fd, new_mapped) != 0) return 1;
+        // only the new chunk is mapped, lines already handed out stay where they are
+        void *chunk = mmap(p->text + p->spool_mapped, SPOOL_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                           p->spool_fd, p->spool_mapped);
+        if (chunk == MAP_FAILED) return 1;
+        p->spool_mapped = new_mapped;
+    }
+    memcpy(p->text + p->text_length, line, line_length);
+    p->text_length += line_length;
+    return 0;
+}
+
+static int publish_spooled_lines(Program *p, int *new_offsets, int n_new) {
+    // line_offsets and the page table may move, readers hold shellmemory_lock or the table lock
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
+    int new_length = p->length + n_new;
+    if (new_length + 1 > p->line_capacity) {
+        int capacity = p->line_capacity;
+        while (new_length + 1 > capacity) capacity *= 2;
+        int *tmp = realloc(p->line_offsets, sizeof(int) * capacity);
+        if (tmp == NULL) {
+            pthread_mutex_unlock(&shellmemory_lock);
+            return 1;
+        }
+        p->line_offsets = tmp;
+        p->line_capacity = capacity;
+    }
+    int new_pages = convert_length_to_pages(new_length, program_get_page_size(p));
+    program_lock_table(p);
+    if (new_pages > p->page_capacity) {
+        int capacity = p->page_capacity;
+        while (new_pages > capacity) capacity *= 2;
+        int *tmp = realloc(p->frames_idx, sizeof(int) * capacity);
+        if (tmp == NULL) {
+            program_unlock_table(p);
+            pthread_mutex_unlock(&shellmemory_lock);
+            return 1;
+        }
+        p->frames_idx = tmp;
+        p->page_capacity = capacity;
+    }
+    for (int i = p->num_of_frames; i < new_pages; i++) {
+        p->frames_idx[i] = -1;
+    }
+    memcpy(p->line_offsets + p->length + 1, new_offsets, sizeof(int) * n_new);
+    p->length = new_length;
+    p->num_of_frames = new_pages;
+    program_unlock_table(p);
+    pthread_mutex_unlock(&shellmemory_lock);
+    return 0;
+}
+
+int program_spool_lines(Program *p, int target_length) {
+    if (!p->streaming) return 0;
+    int n_new = 0;
+    int capacity = 16;
+    int *new_offsets = malloc(sizeof(int) * capacity);
+    if (new_offsets == NULL) return 1;
+    char line[MAX_LINE_LENGTH];
+
+    while (p->length + n_new < target_length) {
+        if (fgets(line, MAX_LINE_LENGTH, p->spool_source) == NULL) {
+            end_spool(p);
+            break;
+        }
+        if (n_new == capacity) {
+            capacity *= 2;
+            int *tmp = realloc(new_offsets, sizeof(int) * capacity);
+            if (tmp == NULL) break;
+            new_offsets = tmp;
+        }
+        if (spool_append(p, line, strlen(line))) {
+            printf("Couldn't spool batch script\n");
+            end_spool(p);
+            break;
+        }
+        new_offsets[n_new++] = p->text_length;
+    }
+    int errorCode = publish_spooled_lines(p, new_offsets, n_new);
+    free(new_offsets);
+    return errorCode;
+}
+
+int program_is_streaming(Program *p) {
+    return p->streaming;
+}
+
+int program_stdin_spooling() {
+    return __atomic_load_n(&stdin_spool, __ATOMIC_ACQUIRE) != NULL;
+}
+
+void program_finish_stdin_spool() {
+    Program *p = __atomic_load_n(&stdin_spool, __ATOMIC_ACQUIRE);
+    if (p != NULL) {
+        program_spool_lines(p, INT_MAX);
+    }
+}
+
+static void program_drop_image(Program *p) {
+    if (p->reclaimable) reclaimable_image_bytes -= p->image_bytes;
+    program_free_image(p);
+    p->image_bytes = 0;
+}
+
+const char *program_get_line(Program *p, int line_number, int *line_length) {
+    if (p->text == NULL || line_number < 0 || line_number >= p->length) {
+        return NULL;
+    }
+    *line_length = p->line_offsets[line_number + 1] - p->line_offsets[line_number];
+    return p->text + p->line_offsets[line_number];
+}
+
+static int program_image_changed(Program *p, struct stat *st) {
+    return p->size != st->st_size || p->mtime.tv_sec != st->st_mtim.tv_sec || p->mtime.tv_nsec != st->st_mtim.tv_nsec;
+}
+
+int load_page_into_frame_store(Program * p, int page_number) {
     //printf("load_pages_into_frames_arguments: program %s, n_frames %d, next_page %d\n", p->name, n_frames, next_page);
     if (p->frames_idx == NULL) {
         printf("Frame pointers intializer failed for %s\n", p->name);
@@ -45,17 +516,34 @@ int load_page_into_frame_store(Program * p, char** lines, int page_number) {
         printf("Error invalid page number for program %s\n", p->name);
         exit(1);
     }
-    int frame_num = alloc_frame();
+    int frame_num = (p->text != NULL) ? framemap_find_shared(p, page_number) : -1;
     if (frame_num == -1) {
-        return 1;
+        frame_num = alloc_frame(p->page_order);
+        if (frame_num == -1) {
+            return PAGE_NO_FRAME;
+        }
+        //printf("Frame number allocated: %d\n", frame_num);
+        if (p->text != NULL) {  // the image is at hand, a copy in the cold tier would only take up room
+            cold_tier_forget(p, page_number);
+            store_frame(frame_num, p, page_number); 
+            framemap_index(frame_num, p, page_number);
+        }
+        else if (cold_tier_load(p, page_number, frame_num)) {  // the tier's copy was unreadable
+            mem_free_frame(frame_num * frame_size);
+            return PAGE_LOAD_FAILED;
+        }
+    }
+    if (framemap_add(frame_num, p, page_number)) {
+        printf("Couldn't map frame %d for program %s\n", frame_num, p->name);
+        exit(1);
     }
-    //printf("Frame number allocated: %d\n", frame_num);
-    store_frame(frame_num, lines, p->length, page_number); 
+    program_lock_table(p);
     p->frames_idx[page_number] = frame_num;
+    program_unlock_table(p);
     update_mru(frame_num);
     
     p->pages_stored++;
-    return 0;
+    return PAGE_LOADED;
 }
 
 int find_free_page_table_entry(Program *p) {
@@ -70,55 +558,181 @@ int find_free_page_table_entry(Program *p) {
 }
 
 int load_program_page(Program *p, int page_number) {
-    FILE *f = fopen(p->name, "rt");
-
-    if (f == NULL) {
-        return 1;
+    trace_lock(&shellmemory_lock, "shellmemory_lock"); 
+    // image was dropped from the cache, go back to disk unless the page is held in the cold tier
+    if (p->text == NULL && !cold_tier_contains(p, page_number)) {
+        pthread_mutex_unlock(&shellmemory_lock);  // other faults and evictions go on during the read
+        ProgramImage image;
+        if (read_image(program_get_path(p), &image)) return PAGE_LOAD_FAILED;
+        trace_lock(&shellmemory_lock, "shellmemory_lock");
+        if (p->text == NULL) install_image(p, &image);
+        else free_image(&image);  // another PCB of the program reloaded it meanwhile
+        if (p->frames_idx[page_number] != -1) {  // and maybe faulted this very page in too
+            pthread_mutex_unlock(&shellmemory_lock);
+            return PAGE_LOADED;
+        }
     }
-    int script_length = program_get_length(p);
-    char** program_lines = malloc(sizeof(char*) * script_length);
-    char line[MAX_LINE_LENGTH];
-    for (int i = 0; fgets(line, MAX_LINE_LENGTH, f) != NULL; i++) {
-        program_lines[i] = strdup(line);
-    } 
-    pthread_mutex_lock(&shellmemory_lock); 
-    int errorCode = load_page_into_frame_store(p, program_lines, page_number); 
+    int errorCode = load_page_into_frame_store(p, page_number); 
     pthread_mutex_unlock(&shellmemory_lock);
-    fclose(f);
-    free_array(program_lines, script_length);
     return errorCode;
 }
 int program_destroy(Program *p) {
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
+    int errorCode = program_destroy_unlocked(p);
+    pthread_mutex_unlock(&shellmemory_lock);
+    return errorCode;
+}
+
+static void program_free_key(void *ptr) {
+    Program *p = ptr;
+    free(p->name);
+    free(p->path);
+    free(p);
+}
+
+int program_destroy_unlocked(Program *p) {
     if (p == NULL) return 1;
-    if (p->pcb_pointing != 0) return 1;
+    if (program_get_pcb_pointing(p) != 0) return 1;
     if (p->name == NULL) return 1; 
 
-    prog_mem_free(p);
+    unlink_reclaimable(p);
+    if (p->streaming) end_spool(p);
+    prog_mem_free_unlocked(p);
+    cold_tier_drop_program(p);
     remove_prog_from_table(p);
 
-    free(p->name);
+    program_free_image(p);
     free(p->frames_idx);
-    free(p);
+    pthread_mutex_destroy(&p->table_lock);
+    epoch_retire(p, program_free_key);  // a lock-free lookup may still be reading its key
     return 0;
 }
 
+static void unlink_reclaimable(Program *p) {
+    if (!p->reclaimable) return;
+    reclaimable_image_bytes -= p->image_bytes;
+    if (p->reclaim_prev != NULL) p->reclaim_prev->reclaim_next = p->reclaim_next;
+    else reclaimable_head = p->reclaim_next;
+    if (p->reclaim_next != NULL) p->reclaim_next->reclaim_prev = p->reclaim_prev;
+    else reclaimable_tail = p->reclaim_prev;
+    p->reclaim_prev = NULL;
+    p->reclaim_next = NULL;
+    p->reclaimable = 0;
+}
 
-int program_get_pcb_pointing(Program *p) {
-    return p->pcb_pointing;
+static void program_invalidate(Program *p) {
+    unhash_prog(p);
+    if (program_get_pcb_pointing(p) == 0) {
+        program_destroy_unlocked(p);
+    }
+    else {
+        __atomic_store_n(&p->stale, 1, __ATOMIC_RELEASE);
+    }
 }
 
-void program_inc_pcb_pointing(Program *p) {
-    p->pcb_pointing++;
+static int image_changed_since_read(Program *p, struct stat *st) {  // may race a reload, a torn read only reports a change
+    return __atomic_load_n(&p->size, __ATOMIC_RELAXED) != st->st_size ||
+           __atomic_load_n(&p->mtime.tv_sec, __ATOMIC_RELAXED) != st->st_mtim.tv_sec ||
+           __atomic_load_n(&p->mtime.tv_nsec, __ATOMIC_RELAXED) != st->st_mtim.tv_nsec;
 }
 
-void program_dec_pcb_pointing(Program *p) {
-    p->pcb_pointing--;
+// Attaches to a program some PCB already runs without taking shellmemory_lock: such a program isn't
+// on the reclaim list, so taking a reference is a compare-and-swap that never revives a count of 0
+static Program *acquire_running_program(char *name) {
+    if (!epoch_enter()) return NULL;
+    struct stat st;
+    Program *p = lookup_program(name, &st);
+    int pointing = (p != NULL) ? __atomic_load_n(&p->pcb_pointing, __ATOMIC_ACQUIRE) : 0;
+    while (pointing > 0 &&
+           !__atomic_compare_exchange_n(&p->pcb_pointing, &pointing, pointing + 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    }
+    if (pointing == 0) p = NULL;
+    epoch_exit();
+    if (p != NULL && (__atomic_load_n(&p->stale, __ATOMIC_ACQUIRE) || (p->path != NULL && image_changed_since_read(p, &st)))) {
+        program_release(p);  // edited on disk, the locked path invalidates it
+        p = NULL;
+    }
+    return p;
+}
+
+Program *program_acquire(char *name) {
+    Program *p = acquire_running_program(name);
+    if (p != NULL) return p;
+
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
+    struct stat st;
+    p = lookup_program(name, &st);
+    if (p != NULL && p->path != NULL && program_image_changed(p, &st)) {
+        program_invalidate(p);  // the script was edited since it was cached
+        p = NULL;
+    }
+    if (p != NULL) {
+        unlink_reclaimable(p);  // re-attached before its frames were reused: warm start
+        __atomic_add_fetch(&p->pcb_pointing, 1, __ATOMIC_ACQUIRE);
+    }
+    pthread_mutex_unlock(&shellmemory_lock);
+    return p;
+}
+
+int program_reclaim_if_empty(Program *p) {
+    if (program_get_pcb_pointing(p) == 0 && p->pages_stored == 0 && p->text == NULL && p->cold_pages == 0) {
+        return program_destroy_unlocked(p);  // nothing left worth re-attaching to
+    }
+    return 1;
+}
+
+static void enforce_cache_budget() {  // least recently finished first, until the rest fit
+    Program *curr = reclaimable_head;
+    while (curr != NULL && reclaimable_image_bytes > (size_t)program_cache_size) {  // config keeps it >= 0
+        Program *next = curr->reclaim_next;
+        if (curr->text != NULL) {
+            program_drop_image(curr);
+            program_reclaim_if_empty(curr);
+        }
+        curr = next;
+    }
+}
+
+void program_release(Program *p) {
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
+    if (__atomic_sub_fetch(&p->pcb_pointing, 1, __ATOMIC_RELEASE) == 0) {  // only the locked path takes it back from 0
+        if (p->path == NULL || p->stale || (p->pages_stored == 0 && p->text == NULL && p->cold_pages == 0)) {  // background programs can't be exec'd again
+            program_destroy_unlocked(p);
+        }
+        else {
+            p->reclaim_prev = reclaimable_tail;
+            p->reclaim_next = NULL;
+            if (reclaimable_tail != NULL) reclaimable_tail->reclaim_next = p;
+            else reclaimable_head = p;
+            reclaimable_tail = p;
+            p->reclaimable = 1;
+            reclaimable_image_bytes += p->image_bytes;
+            enforce_cache_budget();
+        }
+    }
+    pthread_mutex_unlock(&shellmemory_lock);
+}
+
+Program *program_oldest_reclaimable() {
+    return reclaimable_head;
+}
+
+Program *program_next_reclaimable(Program *p) {
+    return p->reclaim_next;
+}
+
+int program_get_pcb_pointing(Program *p) {
+    return __atomic_load_n(&p->pcb_pointing, __ATOMIC_ACQUIRE);  // acquire_running_program adds to it without a lock
 }
 
 const char* program_get_name(Program *p) {
     return p->name;
 }
 
+const char* program_get_path(Program *p) {
+    return (p->path != NULL) ? p->path : p->name;
+}
+
 int program_get_num_of_frames(Program *p) {
     return p->num_of_frames;
 }
@@ -126,6 +740,14 @@ int program_get_num_of_frames(Program *p) {
 void program_dec_pages_stored(Program *p) {
     p->pages_stored--;
 }
+void program_add_cold_pages(Program *p, int delta) {
+    p->cold_pages += delta;
+}
+
+int program_get_cold_pages(Program *p) {
+    return p->cold_pages;
+}
+
 int program_get_pages_stored(Program *p) {
     return p->pages_stored;
 }
@@ -151,111 +773,191 @@ int program_update_page_table_entry(Program *p, int page_number, int frame_numbe
         printf("Error: %s page table couldn't be updated : invalid page_number %d\n", p->name, page_number);
         return 1;
     }
-    else if (frame_number >= (FRAME_STORE_SIZE/FRAME_SIZE)) {
+    else if (frame_number >= frame_store_num_of_frames()) {
         printf("Error: frame_number (%d) argument for program %s isn't valid\n", frame_number, p->name);
         return 1;
     }
+    program_lock_table(p);  // waits for a worker still reading the frame through this entry
     p->frames_idx[page_number] = frame_number; 
+    program_unlock_table(p);
     return 0;
 }
 
-int program_set_length(Program *p) {
-     FILE *f = fopen(p->name, "rt");
+void program_lock_table(Program *p) {
+    pthread_mutex_lock(&p->table_lock);
+}
+
+void program_unlock_table(Program *p) {
+    pthread_mutex_unlock(&p->table_lock);
+}
 
-    if (f == NULL) {
-        return 1;    
+int program_get_length(Program *p) {
+    return p->length;
+}
+
+int convert_length_to_pages(int length, int page_size) {
+    if (length % page_size == 0) {
+        return length/page_size;
     }
-   
-    char line[MAX_LINE_LENGTH];
-    int script_length = 0;
+    else {
+        return length/page_size + 1;
+    }
+}
 
-    while (fgets(line, MAX_LINE_LENGTH, f) != NULL) {
-        script_length++;
+int program_get_page_order(Program *p) {
+    return p->page_order;
+}
+
+int program_get_page_size(Program *p) {
+    return frame_size << p->page_order;
+}
+
+// Long scripts get pages of 2^k frames when they fill at least HUGE_PAGE_MIN_PAGES of them,
+// a page never takes more than a quarter of the frame store
+static int choose_page_order(int length) {
+    int max_order = buddy_max_order() - 2;
+    if (max_order > huge_page_order) max_order = huge_page_order;
+    int order = 0;
+    while (order < max_order && (frame_size << (order + 1)) * HUGE_PAGE_MIN_PAGES <= length) {
+        order++;
     }
+    return order;
+}
 
-    if (script_length == 0) {
-        printf("Script is empty\n");
-        fclose(f);
-        return 1;
+int program_init_page_table(Program *p) {
+    p->page_order = choose_page_order(p->length);
+    p->num_of_frames = convert_length_to_pages(p->length, program_get_page_size(p)); 
+    p->page_capacity = p->num_of_frames + 1;
+    p->frames_idx = malloc(sizeof(int) * p->page_capacity);
+    if (p->frames_idx == NULL) return 1;
+    for (int i =0; i < p->num_of_frames; i++) {
+        p->frames_idx[i] = -1;
     }
-    p->length = script_length;
-    fclose(f);
     return 0;
 }
 
-void background_program_set_length(Program *p, int script_length) {
-    p->length = script_length;
+static int finish_load_program(Program *p) {
+    if (p->length == 0) {  // not an error: the PCB completes at once and the exec's other scripts still run
+        printf("Script is empty\n");
+    }
+    if (program_init_page_table(p)) return 1;
+    return program_load_initial_pages(p);
 }
 
-int program_get_length(Program *p) {
-    return p->length;
+int init_load_program(Program *p) { 
+    if (program_read_image(p)) return 1;
+    return finish_load_program(p);
 }
 
-int convert_length_to_pages(int length) {
-    if (length % FRAME_SIZE == 0) {
-        return length/FRAME_SIZE;
-    }
-    else {
-        return length/FRAME_SIZE + 1;
+typedef struct ImageLoad {
+    Program **programs;
+    int count;
+    int next;     // next program to claim
+    int *failed;
+} ImageLoad;
+
+static void *image_loader(void *arg) {
+    ImageLoad *load = arg;
+    int i;
+    while ((i = __atomic_fetch_add(&load->next, 1, __ATOMIC_RELAXED)) < load->count) {
+        load->failed[i] = program_read_image(load->programs[i]);  // only touches programs[i]
     }
+    return NULL;
 }
 
-int init_load_program(Program *p) { 
-    program_set_length(p);
-    int script_length = p->length;
-    p->num_of_frames = convert_length_to_pages(script_length); 
-    p->frames_idx = malloc(sizeof(int) * p->num_of_frames);
-    for (int i =0; i < p->num_of_frames; i++) {
-        p->frames_idx[i] = -1;
+// Reads and indexes the images of freshly created programs on up to LOADER_THREADS threads, then sets up
+// their page tables and first pages one at a time in array order, so frames are handed out exactly as with
+// one init_load_program each. Returns the index of the first program that failed to load, or -1.
+int init_load_programs(Program **programs, int count) {
+    int failed[count];
+    ImageLoad load = {programs, count, 0, failed};
+    disk_cache_enabled();  // creates the cache directory before the loaders race on it
+
+    pthread_t loaders[LOADER_THREADS];
+    int started = 0;
+    while (started < LOADER_THREADS - 1 && started < count - 1 &&
+           pthread_create(&loaders[started], NULL, image_loader, &load) == 0) {
+        started++;
     }
-    int n_frames = (script_length <= FRAME_SIZE) ? 1 : 2;
+    image_loader(&load);  // the caller is a loader too
+    for (int i = 0; i < started; i++) {
+        pthread_join(loaders[i], NULL);
+    }
+
+    int first_failed = -1;
+    for (int i = 0; i < count; i++) {
+        if ((failed[i] || finish_load_program(programs[i])) && first_failed == -1) first_failed = i;
+    }
+    return first_failed;
+}
+
+int program_load_initial_pages(Program *p) {
+    int n_frames = (p->num_of_frames < 2) ? p->num_of_frames : 2;
     for (int i=0; i<n_frames; i++) {
-        if (load_program_page(p, i)) {
-            if (evict_lru_frame()) return 1;
-            if (load_program_page(p, i)) return 1;
+        int loaded;
+        while ((loaded = load_program_page(p, i)) == PAGE_NO_FRAME) {
+            if (evict_frame()) return 1;
         } 
+        if (loaded == PAGE_LOAD_FAILED) return 1;
     } 
     return 0;
 }
 
-void background_program_set_frames_idx(Program *bg, int n_frames) {
-    bg->num_of_frames = n_frames;
-    bg->frames_idx = malloc(sizeof(int) * n_frames);
-}
+static Program *lookup_program(char *name, struct stat *st) {  // under shellmemory_lock or an epoch
+    ProgramBuckets *buckets = __atomic_load_n(&program_buckets, __ATOMIC_ACQUIRE);
+    if (buckets == NULL) return NULL;
 
-Program *find_program_in_table(char *name) {
-    for (int i=0; i<program_table_size; i++) {
-        if (strcmp(program_table[i]->name, name) == 0) {
-            return program_table[i];
+    int is_file = (stat(name, st) == 0);
+    unsigned long hash = is_file ? hash_file_key(st->st_dev, st->st_ino) : hash_name_key(name);
+
+    Program *p = __atomic_load_n(&buckets->heads[hash % buckets->count], __ATOMIC_ACQUIRE);
+    for (; p != NULL; p = __atomic_load_n(&p->hash_next, __ATOMIC_ACQUIRE)) {
+        if (program_matches_key(p, hash, is_file, st->st_dev, st->st_ino, name)) {
+            return p;
         }
     }
     return NULL;
 }
 
-int remove_prog_from_table(Program *p) {
-    int idx = p->table_idx;
-    if (p != program_table[idx]) {
-        return 1;
+Program *find_program_in_table(char *name) {
+    struct stat st;
+    return lookup_program(name, &st);
+}
+
+static int unhash_prog(Program *p) {
+    if (program_buckets == NULL) return 1;
+    Program **link = &program_buckets->heads[p->hash % program_buckets->count];
+    while (*link != NULL && *link != p) {
+        link = &(*link)->hash_next;
     }
-    for (int i = p->table_idx; i<program_table_size - 1; i++) {
-        Program* left_shifted = program_table[i+1];
-        program_table[i] = left_shifted;
-        left_shifted->table_idx--;
-        
+    if (*link == NULL) {
+        return 1;  // already unhashed when the program went stale
     }
+    __atomic_store_n(link, p->hash_next, __ATOMIC_RELEASE);  // p->hash_next stays valid for a reader standing on p
+    return 0;
+}
+
+int remove_prog_from_table(Program *p) {
+    unhash_prog(p);
+
+    if (p->table_prev != NULL) p->table_prev->table_next = p->table_next;
+    else program_table_head = p->table_next;
+    if (p->table_next != NULL) p->table_next->table_prev = p->table_prev;
+    else program_table_tail = p->table_prev;
+    p->table_prev = NULL;
+    p->table_next = NULL;
     program_table_size--;
-    p->table_idx = -1;
     return 0;
 }
 
+Program *program_table_first() {
+    return program_table_head;
+}
 
-int program_already_exists(char *name) {
-    int found = 0;
-    for (int i = 0; i<program_table_size; i++) {
-        if (strcmp(name, program_table[i]->name) == 0) {
-            found = 1;
-            break;
-        }
-    }
-    return found;
-}
\ No newline at end of file
+Program *program_table_next(Program *p) {
+    return p->table_next;
+}
+
+int program_table_count() {
+    return program_table_size;
+}
@@ -1,13 +1,24 @@
 #ifndef PROGRAM_H
 #define PROGRAM_H
+#include <stdio.h>
 typedef struct Program Program;
-extern Program *program_table[];
-extern int program_table_size;
 Program *program_create(char *name); 
+Program *background_program_create(char *name);
 int program_destroy(Program *p);
+int program_destroy_unlocked(Program *p);
+Program *program_acquire(char *name);
+void program_release(Program *p);
+Program *program_oldest_reclaimable();
+Program *program_next_reclaimable(Program *p);
+int program_reclaim_if_empty(Program *p);
 
 
-int load_page_into_frame_store(Program * p, char** lines, int page_number);
+// load_page_into_frame_store and load_program_page results
+#define PAGE_LOADED 0
+#define PAGE_NO_FRAME 1      // no free frame, evict one and retry
+#define PAGE_LOAD_FAILED 2   // the page's lines couldn't be read, evicting won't help
+
+int load_page_into_frame_store(Program * p, int page_number);
 
 int load_program_page(Program *p, int page_number);
 int find_free_page_table_entry(Program *p);
@@ -15,20 +26,35 @@ int find_free_page_table_entry(Program *p);
 int program_get_frame(Program *p, int idx);
 int program_get_num_of_frames(Program *p);
 int program_get_pcb_pointing(Program *p); 
-void program_inc_pcb_pointing(Program *p);
-void program_dec_pcb_pointing(Program *p); 
 const char* program_get_name(Program *p); 
+const char* program_get_path(Program *p);
 int program_get_length(Program *p);
 void program_dec_pages_stored(Program *p);
 int program_get_pages_stored(Program *p);
+void program_add_cold_pages(Program *p, int delta);
+int program_get_cold_pages(Program *p);
 int init_load_program(Program *p);
-int program_already_exists(char *name);
+int init_load_programs(Program **programs, int count);
 Program *find_program_in_table(char *name);
 int remove_prog_from_table(Program *p);
+Program *program_table_first();
+Program *program_table_next(Program *p);
+int program_table_count();
 int program_update_page_table_entry(Program *p, int page_number, int frame_number);
 int program_get_frame(Program *p, int idx);
-int *program_get_frames_idx(Program *p); 
-void background_program_set_length(Program *p, int script_length);
-void background_program_set_frames_idx(Program *bg, int n_frames);
-int convert_length_to_pages(int length);
+int *program_get_frames_idx(Program *p);
+void program_lock_table(Program *p);
+void program_unlock_table(Program *p); 
+int program_read_image(Program *p);
+int background_program_open_spool(Program *p, FILE *source);
+int program_spool_lines(Program *p, int target_length);
+int program_is_streaming(Program *p);
+int program_stdin_spooling();
+void program_finish_stdin_spool();
+int program_load_initial_pages(Program *p);
+const char *program_get_line(Program *p, int line_number, int *line_length);
+int program_init_page_table(Program *p);
+int convert_length_to_pages(int length, int page_size);
+int program_get_page_order(Program *p);
+int program_get_page_size(Program *p);
 #endif
\ No newline at end of file
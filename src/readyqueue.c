@@ -2,8 +2,10 @@
 #include "pcb.h"
 #include "policies.h"
 #include "scheduler.h"
+#include "fairtree.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 ReadyQueue ready_queue;
 
@@ -11,6 +13,8 @@ void ready_queue_init(ReadyQueue *queue) {
     if (queue == NULL) return;
     queue->head = NULL;
     queue->tail = NULL;
+    queue->fair_root = NULL;
+    queue->min_vruntime = 0;
 }
 
 int ready_queue_enqueue(PCB *pcb, ReadyQueue *queue, Policy *policy) {
@@ -22,7 +26,9 @@ int ready_queue_enqueue(PCB *pcb, ReadyQueue *queue, Policy *policy) {
         printf("PCB already in ready queue\n");
         return 1;
     } 
-    else if (queue->tail == NULL || queue->head == NULL) {  // empty list
+    pcb_mark_queued(pcb);
+    int empty = queue->tail == NULL || queue->head == NULL;
+    if (empty && (policy->enqueue_function != fair_enqueue || pcb_get_background_mode(pcb))) {  // a FAIR PCB still needs its tree node
         queue->head = pcb;
         queue->tail = pcb;
         return 0;
@@ -38,6 +44,84 @@ int ready_queue_enqueue(PCB *pcb, ReadyQueue *queue, Policy *policy) {
     }
 }
 
+// Stable bottom-up merge sort of pcbs by metrics, tmp arrays hold count entries each
+static void sort_by_metric(PCB **pcbs, int *metrics, int count, PCB **tmp_pcbs, int *tmp_metrics) {
+    for (int width = 1; width < count; width *= 2) {
+        for (int start = 0; start < count; start += 2 * width) {
+            int mid = (start + width < count) ? start + width : count;
+            int end = (start + 2 * width < count) ? start + 2 * width : count;
+            int left = start, right = mid, out = start;
+            while (left < mid || right < end) {
+                int take_left = (right == end) || (left < mid && metrics[left] <= metrics[right]);
+                int from = take_left ? left++ : right++;
+                tmp_pcbs[out] = pcbs[from];
+                tmp_metrics[out++] = metrics[from];
+            }
+        }
+        memcpy(pcbs, tmp_pcbs, sizeof(PCB *) * count);
+        memcpy(metrics, tmp_metrics, sizeof(int) * count);
+    }
+}
+
+// Enqueues the PCBs in argument order, the same as one ready_queue_enqueue each. Sorted policies
+// sort the batch once and merge it into the queue in a single pass instead of walking it per PCB.
+int ready_queue_enqueue_batch(PCB **pcbs, int count, ReadyQueue *queue, Policy *policy) {
+    if (pcbs == NULL || queue == NULL) {
+        printf("Input arguments are NULL\n");
+        return 1;
+    }
+    if (policy->enqueue_function != sjf_enqueue || count < 2) {
+        for (int i = 0; i < count; i++) {
+            if (ready_queue_enqueue(pcbs[i], queue, policy)) return 1;
+        }
+        return 0;
+    }
+
+    PCB **sorted = malloc(sizeof(PCB *) * count * 2);
+    int *metrics = malloc(sizeof(int) * count * 2);
+    if (sorted == NULL || metrics == NULL) {
+        free(sorted);
+        free(metrics);
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (pcb_get_next(pcbs[i]) != NULL) {
+            printf("PCB already in ready queue\n");
+            free(sorted);
+            free(metrics);
+            return 1;
+        }
+        pcb_mark_queued(pcbs[i]);
+        sorted[i] = pcbs[i];
+        metrics[i] = policy->get_metric_function(pcbs[i]);
+    }
+    sort_by_metric(sorted, metrics, count, sorted + count, metrics + count);
+
+    PCB *prev = NULL;  // each PCB goes after every queued one with a metric <= its own, as in sjf_enqueue
+    PCB *curr = queue->head;
+    for (int i = 0; i < count; i++) {
+        while (curr != NULL && policy->get_metric_function(curr) <= metrics[i]) {
+            prev = curr;
+            curr = pcb_get_next(curr);
+        }
+        pcb_set_next(sorted[i], curr);
+        if (prev == NULL) queue->head = sorted[i];
+        else pcb_set_next(prev, sorted[i]);
+        prev = sorted[i];
+    }
+    if (curr == NULL) queue->tail = prev;
+    free(sorted);
+    free(metrics);
+    return 0;
+}
+
+int ready_queue_contains(ReadyQueue *queue, PCB *pcb) {  // walks the queue, for error paths only
+    for (PCB *curr = queue->head; curr != NULL; curr = pcb_get_next(curr)) {
+        if (curr == pcb) return 1;
+    }
+    return 0;
+}
+
 PCB *ready_queue_dequeue(ReadyQueue *queue) {
     if (queue == NULL) {
         printf("Ready queue doesn't exist\n");
@@ -54,5 +138,13 @@ PCB *ready_queue_dequeue(ReadyQueue *queue) {
     }
     queue->head = new_head;
     pcb_set_next(prev_head, NULL);
+    pcb_mark_dequeued(prev_head);
+    FairNode *node = pcb_get_fair_node(prev_head);
+    if (node != NULL) {  // a FAIR PCB at the head is the tree's minimum
+        fair_tree_remove(&queue->fair_root, node);
+        free(node);
+        pcb_set_fair_node(prev_head, NULL);
+        if (pcb_get_vruntime(prev_head) > queue->min_vruntime) queue->min_vruntime = pcb_get_vruntime(prev_head);
+    }
     return prev_head;
 }
@@ -7,11 +7,15 @@
 typedef struct ReadyQueue {
     PCB *head;
     PCB *tail;
+    FairNode *fair_root;          // FAIR PCBs, the list stays threaded through them in key order
+    unsigned long min_vruntime;   // never goes back, newcomers start here
 } ReadyQueue;
 // extern ReadyQueue ready_queue;
 
 void ready_queue_init(ReadyQueue *queue);
 int ready_queue_enqueue(PCB *pcb, ReadyQueue *queue, Policy *policy);
+int ready_queue_enqueue_batch(PCB **pcbs, int count, ReadyQueue *queue, Policy *policy);
+int ready_queue_contains(ReadyQueue *queue, PCB *pcb);
 PCB *ready_queue_dequeue(ReadyQueue *queue);
 
 #endif
@@ -12,79 +12,229 @@
 #include "program.h"
 #include "paging.h"
 #include "lru.h"
+#include "config.h"
+#include <time.h>
+#include "trace.h"
 
-extern pthread_mutex_t shellmemory_lock;
 extern int multithreaded_mode;
 extern pthread_mutex_t interpreter_lock;
 
-int create_pcb_and_enqueue(char *script, ReadyQueue *queue, Policy *policy) {
-    Program *prog;  
-    if (!program_already_exists(script)) {
+static PCB *create_pcb(char *script, const PCBOptions *options) {  // loads the script, doesn't need ready_queue_lock
+    Program *prog = program_acquire(script);
+    if (prog == NULL) {
         prog = program_create(script);
-        if (init_load_program(prog)) return 1;
+        if (prog == NULL) return NULL;
+        if (init_load_program(prog)) {
+            program_release(prog);
+            return NULL;
+        }
+    }
+    PCB *new_pcb = pcb_create(prog); 
+    pcb_set_options(new_pcb, options);
+    return new_pcb;
+}
+
+// Loads every script of one exec, the programs not cached yet in parallel (see init_load_programs).
+// Returns the index of the first script that couldn't be loaded, with no PCB left behind, or -1.
+int create_pcbs(char **scripts, const PCBOptions *options, int count, PCB **pcbs) {
+    Program *programs[count];
+    Program *fresh[count];
+    int n_fresh = 0;
+    int failed = -1;
+
+    for (int i = 0; i < count; i++) {
+        programs[i] = NULL;
+        int repeated = 0;
+        for (int j = 0; j < i; j++) {
+            if (strcmp(scripts[i], scripts[j]) == 0) repeated = 1;  // acquired below, once the first copy is loaded
+        }
+        if (repeated) continue;
+        programs[i] = program_acquire(scripts[i]);
+        if (programs[i] == NULL) {
+            programs[i] = program_create(scripts[i]);
+            if (programs[i] == NULL) {
+                failed = i;
+                break;
+            }
+            fresh[n_fresh++] = programs[i];
+        }
+    }
+    if (failed == -1 && n_fresh > 0) {
+        int failed_fresh = init_load_programs(fresh, n_fresh);
+        for (int i = 0; i < count && failed_fresh != -1; i++) {
+            if (programs[i] == fresh[failed_fresh]) failed = i;
+        }
+    }
+    for (int i = 0; i < count && failed == -1; i++) {
+        if (programs[i] == NULL && (programs[i] = program_acquire(scripts[i])) == NULL) failed = i;
     }
+
+    for (int i = 0; i < count; i++) {
+        if (programs[i] == NULL) continue;
+        if (failed != -1) {
+            program_release(programs[i]);
+            continue;
+        }
+        pcbs[i] = pcb_create(programs[i]);
+        pcb_set_options(pcbs[i], &options[i]);
+    }
+    return failed;
+}
+
+int create_pcb_and_enqueue(char *script, ReadyQueue *queue, Policy *policy, const PCBOptions *options) {
+    PCB *new_pcb = create_pcb(script, options);
+    if (new_pcb == NULL) return 1;
+    PCB *batch[1] = {new_pcb};
+    int errorCode = admit_and_enqueue_batch(batch, 1, queue, policy);
+    if (errorCode == 0 && batch[0] == NULL) return 2;
+    return errorCode;
+}
+
+// After a failed enqueue, destroys the PCBs that didn't make it into the queue and sets them to NULL
+static void destroy_unqueued(PCB **pcbs, int count, ReadyQueue *queue) {
+    for (int i = 0; i < count; i++) {
+        if (pcbs[i] != NULL && !ready_queue_contains(queue, pcbs[i])) {
+            pcb_destroy(pcbs[i]);
+            pcbs[i] = NULL;
+        }
+    }
+}
+
+// Enqueues one exec's PCBs at once, the caller holds ready_queue_lock in multithreaded mode.
+// Admission is checked in argument order since each script's check depends on the ones before it;
+// rejected PCBs are destroyed and set to NULL, and so is every PCB left out when enqueuing fails.
+int admit_and_enqueue_batch(PCB **pcbs, int count, ReadyQueue *queue, Policy *policy) {
+    if (policy->admit_function == NULL) {
+        if (ready_queue_enqueue_batch(pcbs, count, queue, policy)) {
+            destroy_unqueued(pcbs, count, queue);
+            return 1;
+        }
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (policy->admit_function(pcbs[i], queue)) {
+            pcb_destroy(pcbs[i]);
+            pcbs[i] = NULL;
+        }
+        else if (ready_queue_enqueue(pcbs[i], queue, policy)) {
+            destroy_unqueued(pcbs, count, queue);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// One pass of the scheduling loop: a slice of *running, which AGING lets keep the CPU, or of the queue head
+static int scheduler_step(ReadyQueue *queue, Policy *policy, PCB **running) {
+    PCB *process = *running;
+    *running = NULL;
+    if (process == NULL) {
+        process = ready_queue_dequeue(queue);
+        pcb_mark_dispatched(process);
+    }
+
+    int errorCode = exec_program(process, queue, policy);
+    age_queue(queue);
+
+    // program not done, job length reached
+    if (!process_completed(process)) {
+        if (aging_and_score_is_smallest(process, queue, policy)) {
+            *running = process;
+            return 0;
+        }
+
+        errorCode = ready_queue_enqueue(process, queue, policy);
+        if (errorCode) {
+            printf("Couldn't enqueue uncompleted process\n"); 
+            return errorCode;
+        }
+    } 
     else {
-        prog = find_program_in_table(script);
-        if (prog == NULL) return 1; 
+        pcb_destroy(process);   // program done, we free the pcb and program from memory
     }
-    PCB *new_pcb = pcb_create(prog); 
-    return ready_queue_enqueue(new_pcb, queue, policy);
+    return 0;
 }
 
 int run_scheduler(ReadyQueue *queue, Policy *policy) {
-    int dequeue_allowed = 1;
-    PCB *process = NULL;
+    PCB *running = NULL;
+    int deferring = defer_scheduling;  // an exec nested in one of these slices runs at once, as it always did
+    defer_scheduling = 0;
 
     while ((queue->head != NULL) && (queue->tail != NULL)) {
-        if (dequeue_allowed) {
-            process = ready_queue_dequeue(queue);
+        int errorCode = scheduler_step(queue, policy, &running);
+        if (errorCode) {
+            defer_scheduling = deferring;
+            return errorCode;
         }
+    }
 
-        dequeue_allowed = 0;
+    defer_scheduling = deferring;
+    return 0;
+}
 
-        int errorCode = exec_program(process, queue, policy);
-        age_queue(queue);
+// Interactive single-threaded mode: an exec typed at the prompt only queues its PCBs under
+// deferred_policy, and the shell's event loop runs their slices one at a time between commands
+int defer_scheduling = 0;  // set while the event loop runs a typed command
+static Policy deferred_policy;
+static int deferred = 0;   // the ready queue belongs to deferred_policy
+static PCB *deferred_running = NULL;
 
-        // program not done, job length reached
-        if (!process_completed(process)) {
-            if (aging_and_score_is_smallest(process, queue, policy)) {
-                continue;
-            }
+int scheduler_defer(Policy *policy) {  // 1 when PCBs are deferred under another policy, drain them first
+    if (deferred && !policy_same(&deferred_policy, policy)) return 1;
+    if (!deferred) deferred_policy = *policy;
+    deferred = 1;
+    return 0;
+}
 
-            errorCode = ready_queue_enqueue(process, queue, policy);
-            if (errorCode) {
-                printf("Couldn't enqueue uncompleted process\n"); 
-                return errorCode;
-            }
-        } 
-        else {
-            pcb_destroy(process);   // program done, we free the pcb and program from memory
-        }
+int scheduler_has_deferred() {
+    return deferred;
+}
 
-        dequeue_allowed = 1;
+int scheduler_step_deferred(ReadyQueue *queue) {
+    if (!deferred) return 0;
+    int errorCode = 0;
+    if (deferred_running != NULL || (queue->head != NULL && queue->tail != NULL)) {
+        errorCode = scheduler_step(queue, &deferred_policy, &deferred_running);
     }
+    if (deferred_running == NULL && queue->head == NULL) deferred = 0;
+    return errorCode;
+}
 
-    return 0;
+int scheduler_drain_deferred(ReadyQueue *queue) {  // before anything that schedules the ready queue by itself
+    int deferring = defer_scheduling;
+    defer_scheduling = 0;
+    int errorCode = 0;
+    while (deferred && !errorCode) {
+        errorCode = scheduler_step_deferred(queue);
+    }
+    defer_scheduling = deferring;
+    return errorCode;
 }
 
 int process_completed(PCB *process) {
     int prog_length = pcb_get_program_size(process); 
-    return pcb_get_pc(process) == prog_length;
+    return pcb_get_pc(process) == prog_length && !program_is_streaming(pcb_get_program(process));
 }
 
 int exec_program(PCB *process, ReadyQueue *queue, Policy *policy) { 
-    int prog_length = pcb_get_program_size(process);
-    int pc;
     int errorCode = 0;
     int lines_executed = 0;
+    int time_slice = policy_get_time_slice(policy, process);
+    struct timespec slice_start;
+    if (policy->time_slice_ns > 0) clock_gettime(policy->clock_id, &slice_start);
+    pcb_mark_slice_started(process);
 
-    while (((pc = pcb_get_pc(process)) != prog_length) && (lines_executed != policy->job_length)) {
-        pthread_mutex_lock(&shellmemory_lock);
+    while (!process_completed(process) && (lines_executed != time_slice)) {
+        Program *program = pcb_get_program(process);
+        program_lock_table(program);  // keeps the frame from being evicted and freed while we copy the line
         int address = pcb_get_physical_address(process);
         if (address == -1) {
-            pthread_mutex_unlock(&shellmemory_lock);
+            program_unlock_table(program);
             int errorCode = handle_page_fault(process);
             if (errorCode) exit(1);
+            pcb_count_fault(process);
+            pcb_mark_preempted(process, lines_executed);
+            if (policy->slice_done_function != NULL) policy->slice_done_function(process, lines_executed);
             return errorCode;
         }
         //printf("address: %d\n", address); 
@@ -92,10 +242,10 @@ int exec_program(PCB *process, ReadyQueue *queue, Policy *policy) {
         int frame_number = pcb_get_frame_number(process);
         update_mru(frame_number);
         
-        pthread_mutex_unlock(&shellmemory_lock);
+        program_unlock_table(program);
 
         if (multithreaded_mode) {
-            pthread_mutex_lock(&interpreter_lock);
+            trace_lock(&interpreter_lock, "interpreter_lock");
         }        
         errorCode = parseLine(curr_command);
 
@@ -112,8 +262,14 @@ int exec_program(PCB *process, ReadyQueue *queue, Policy *policy) {
         }
         pcb_increment_pc(process);
         lines_executed++;
+        if (policy->time_slice_ns > 0 && lines_executed % RR_CLOCK_CHECK_INTERVAL == 0 &&
+            policy_slice_expired(policy, &slice_start)) {
+            break;
+        }
     }
 
+    pcb_mark_preempted(process, lines_executed);
+    if (policy->slice_done_function != NULL) policy->slice_done_function(process, lines_executed);
     return errorCode;
 }
 
@@ -7,8 +7,15 @@ typedef struct ReadyQueue ReadyQueue;
 extern ReadyQueue ready_queue;
 typedef struct Policy Policy;
 
-int create_pcb_and_enqueue(char *script, ReadyQueue *queue, Policy *policy);
+int create_pcbs(char **scripts, const PCBOptions *options, int count, PCB **pcbs);
+int admit_and_enqueue_batch(PCB **pcbs, int count, ReadyQueue *queue, Policy *policy);
+int create_pcb_and_enqueue(char *script, ReadyQueue *queue, Policy *policy, const PCBOptions *options);
 int run_scheduler(ReadyQueue *queue, Policy *policy);
+extern int defer_scheduling;
+int scheduler_defer(Policy *policy);
+int scheduler_has_deferred();
+int scheduler_step_deferred(ReadyQueue *queue);
+int scheduler_drain_deferred(ReadyQueue *queue);
 int process_completed(PCB *process);
 int exec_program(PCB *process, ReadyQueue *queue, Policy *policy);
 
@@ -5,12 +5,16 @@
 #include "readyqueue.h"
 #include "scheduler.h"
 #include "shellmemory.h"
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include "lru.h"
+#include "program.h"
+#include "metrics.h"
+#include "trace.h"
 
 pthread_t main_thread_id;
 extern int request_quit;
@@ -19,9 +23,21 @@ int parseInput(const char ui[]);
 int quit();
 extern int multithreaded_mode;
 
+// Runs slices of the scripts exec queued at the prompt until a command is typed (see scheduler_defer)
+static void wait_for_input() {
+    fflush(stdout);
+    struct pollfd input = {.fd = STDIN_FILENO, .events = POLLIN};
+    while (scheduler_has_deferred() && poll(&input, 1, 0) == 0) {
+        if (scheduler_step_deferred(&ready_queue)) break;
+    }
+}
+
 // Start of everything
 int main(int argc, char *argv[]) {
-    printf("Frame Store Size = %d; Variable Store Size = %d\n", FRAME_STORE_SIZE, MEM_SIZE);
+    if (config_init(argc, argv)) return 1;
+    if (trace_file != NULL && trace_init(trace_file)) return 1;
+    trace_register_thread("main");
+    printf("Frame Store Size = %d; Variable Store Size = %d\n", frame_store_size, mem_size);
     fflush(stdout);
 
     char prompt = '$';               // Shell prompt
@@ -36,9 +52,11 @@ int main(int argc, char *argv[]) {
     // we check if the stdin stream comes from a file or user input / terminal
     // (batch vs interactive mode)
     int interactiveMode = isatty(STDIN_FILENO);
+    // an interactive single-threaded shell keeps running queued scripts while it waits for the next command
+    int eventLoop = interactiveMode && event_loop;
+    if (eventLoop) setvbuf(stdin, NULL, _IONBF, 0);  // nothing read ahead, so poll sees whether a command is waiting
 
-    mem_init();
-    frame_store_init();
+    if (mem_init() || frame_store_init()) return 1;
     ready_queue_init(&ready_queue);
     if (lru_map_init()) return 1;
 
@@ -48,16 +66,19 @@ int main(int argc, char *argv[]) {
         if (interactiveMode) {
             printf("%c ", prompt);
         }
+        if (eventLoop && !multithreaded_mode) wait_for_input();
 
-        if (fgets(userInput, MAX_USER_INPUT - 1, stdin) == NULL) {  // fgets returns NULL when it reaches the end of the file (relevant for batch mode)
+        // a background batch script owns whatever is left of stdin, for the shell that's the end of its input
+        if (program_stdin_spooling() || fgets(userInput, MAX_USER_INPUT - 1, stdin) == NULL) {  // fgets returns NULL when it reaches the end of the file (relevant for batch mode)
             int bye_already_printed = 0;
+            scheduler_drain_deferred(&ready_queue);
 
             if (multithreaded_mode) {
                 // if EOF has been reached in multithreaded mode, it means
                 // main thread has processed all input commands
                 // so now we wait for the workers to finish processing the ready queue and exit
                 handle_quit();
-                pthread_mutex_lock(&ready_queue_lock);
+                trace_lock(&ready_queue_lock, "ready_queue_lock");
                 if (request_quit) {
                     bye_already_printed = 1;
                 }
@@ -67,18 +88,22 @@ int main(int argc, char *argv[]) {
             if (!bye_already_printed) {
                 printf("Bye!\n");
             }
+            metrics_report_on_exit();
             return 0;
         }
 
+        defer_scheduling = eventLoop && !multithreaded_mode;
         errorCode = parseLine(userInput);
+        defer_scheduling = 0;
 
         if (multithreaded_mode) {
             // in multithread mode, when a quit command has been processed by a worker thread,
             // we don't wait for EOF to exit, we just let both workers finish and exit
-            pthread_mutex_lock(&ready_queue_lock);
+            trace_lock(&ready_queue_lock, "ready_queue_lock");
             if (request_quit) {
                 pthread_mutex_unlock(&ready_queue_lock);
                 handle_quit();
+                metrics_report_on_exit();
                 exit(0);
             }
             pthread_mutex_unlock(&ready_queue_lock);
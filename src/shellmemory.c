@@ -4,34 +4,39 @@
 #include <string.h>
 #include "config.h"
 #include "program.h"
-#include <stdlib.h>
 #include <stdio.h>
-#include "program.h"
+#include "lru.h"
+#include "buddy.h"
+#include "framemap.h"
+#include "trace.h"
 
 struct memory_struct {
     char *var;
     char *value;
 };
-static char *frame_store[FRAME_STORE_SIZE];
-struct memory_struct shellmemory[MEM_SIZE];
+static char **frame_store;
+struct memory_struct *shellmemory;
 extern pthread_mutex_t shellmemory_lock;
 extern int multithreaded_mode;
 
 // Shell memory functions
 
-void mem_init() {
+int mem_init() {
     int i;
-    for (i = 0; i < MEM_SIZE; i++) {
+    shellmemory = malloc(sizeof(struct memory_struct) * mem_size);
+    if (shellmemory == NULL) return 1;
+    for (i = 0; i < mem_size; i++) {
         shellmemory[i].var = "none";
         shellmemory[i].value = "none";
     }
+    return 0;
 }
 
 // Set key value pair
 void mem_set_value(char *var_in, char *value_in) {
     int i;
 
-    for (i = 0; i < MEM_SIZE; i++) {
+    for (i = 0; i < mem_size; i++) {
         if (strcmp(shellmemory[i].var, var_in) == 0) {
             shellmemory[i].value = strdup(value_in);
             return;
@@ -39,7 +44,7 @@ void mem_set_value(char *var_in, char *value_in) {
     }
 
     // Value does not exist, need to find a free spot.
-    for (i = 0; i < MEM_SIZE; i++) {
+    for (i = 0; i < mem_size; i++) {
         if (strcmp(shellmemory[i].var, "none") == 0) {
             shellmemory[i].var = strdup(var_in);
             shellmemory[i].value = strdup(value_in);
@@ -54,7 +59,7 @@ void mem_set_value(char *var_in, char *value_in) {
 char *mem_get_value(char *var_in) {
     int i;
 
-    for (i = 0; i < MEM_SIZE; i++) {
+    for (i = 0; i < mem_size; i++) {
         if (strcmp(shellmemory[i].var, var_in) == 0) {
             return strdup(shellmemory[i].value);
         }
@@ -62,55 +67,70 @@ char *mem_get_value(char *var_in) {
     return "Variable does not exist";
 }
 
-void frame_store_init() {
-    for (int i = 0; i < FRAME_STORE_SIZE; i++) frame_store[i] = NULL;
+int frame_store_init() {
+    // never moves, workers read it unlocked. A large store comes from fresh zero pages calloc doesn't write, so
+    // each page is placed on the NUMA node of the worker that first loads a line into it (first touch)
+    frame_store = calloc(frame_store_max_frames() * frame_size, sizeof(char *));
+    if (frame_store == NULL) return 1;
+    return buddy_init(frame_store_num_of_frames()) || framemap_init(frame_store_num_of_frames());
 }
 
+int frame_store_num_of_frames() {
+    return frame_store_size / frame_size;
+}
 
+int frame_store_max_frames() {
+    return ((frame_store_max_size > frame_store_size) ? frame_store_max_size : frame_store_size) / frame_size;
+}
 
-int alloc_frame() {
-    int start_idx = -1;          
-    start_idx = search_free_frame(0, FRAME_STORE_SIZE-1);
-
-    if (start_idx == -1) {
-        return start_idx;
-    }
-    return start_idx/FRAME_SIZE;
+// Doubles the frame store, capped at frame_store_max_size; new frames join the LRU list as least recently used
+static int frame_store_grow() {
+    int old_size = frame_store_size;
+    int new_size = (old_size > frame_store_max_size / 2) ? frame_store_max_size : old_size * 2;
+    new_size = (new_size / frame_size) * frame_size;
+    if (new_size <= old_size) return 1;
+    if (lru_map_grow(new_size / frame_size) || buddy_grow(new_size / frame_size) || framemap_grow(new_size / frame_size)) return 1;
+    frame_store_size = new_size;
+    return 0;
 }
 
-void store_frame(int frame_number, char *script[], int script_length, int page_number) {
-    //printf("store_frame_arguments: frame_number %d, script_length %d, page_number %d\n", frame_number, script_length, page_number);
-    for (int i = 0, VA = page_number*FRAME_SIZE; VA<script_length && i < FRAME_SIZE ; i++, VA++) {
-        int PA = frame_number * FRAME_SIZE + i;
-        prog_write_line(PA, script[VA]);
+// Allocates 2^order contiguous frames for one page, returns the first frame number or -1 when none are free
+int alloc_frame(int order) {
+    int frame_number = buddy_alloc(order);
+    while (frame_number == -1 && frame_store_size < frame_store_max_size) {  // under pressure, grow before anyone gets evicted
+        if (frame_store_grow()) break;
+        frame_number = buddy_alloc(order);
+    }
+    if (frame_number == -1) {
+        return frame_number;
     }
+    for (int i = 1; i < (1 << order); i++) lru_remove(frame_number + i);  // a page ages and is evicted through its first frame
+    return frame_number;
 }
 
+int frame_is_page_start(int frame_number) {
+    return buddy_block_order(frame_number) != -1;
+}
 
-int search_free_frame(int start_idx, int end_idx) {
-    if (start_idx >= end_idx) {
-        return -1;
-    }
-    int potential_idx = (rand() % (end_idx-start_idx)) + start_idx;
-    potential_idx = (potential_idx/FRAME_SIZE)*FRAME_SIZE; 
-     
-    if (frame_store[potential_idx] != NULL) {
-        int next_potential_idx = potential_idx + FRAME_SIZE;
-        potential_idx = search_free_frame(start_idx, potential_idx); 
-        if (potential_idx != -1) return potential_idx;
-        else {
-            potential_idx = search_free_frame(next_potential_idx, end_idx);
-        }
+void store_frame(int frame_number, Program *p, int page_number) {
+    int script_length = program_get_length(p);
+    int page_size = program_get_page_size(p);
+    for (int i = 0, VA = page_number*page_size; VA<script_length && i < page_size ; i++, VA++) {
+        int PA = frame_number * frame_size + i;
+        int line_length;
+        const char *line = program_get_line(p, VA, &line_length);
+        frame_store[PA] = strndup(line, line_length);
     }
-    return potential_idx;
-
+}
 
+const char *frame_store_line(int idx) {
+    return frame_store[idx];
 }
 
 void prog_write_line(int idx, const char *line) { frame_store[idx] = strdup(line); }
 
 char *prog_read_line(int idx) {
-    pthread_mutex_lock(&shellmemory_lock);
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
     char *line = prog_read_line_unlocked(idx);
     pthread_mutex_unlock(&shellmemory_lock);
     return line;
@@ -121,18 +141,31 @@ char *prog_read_line_unlocked(int idx) {
 }
 
 void mem_free_frame(int frame_idx) {
-    for (int i = 0; i < FRAME_SIZE; i++) {
+    int frame_number = frame_idx / frame_size;
+    int order = buddy_block_order(frame_number);
+    if (order == -1) return;
+    for (int i = 0; i < (frame_size << order); i++) {
         free(frame_store[frame_idx + i]);
         frame_store[frame_idx + i] = NULL;
     }
-    }
+    for (int i = 1; i < (1 << order); i++) lru_append(frame_number + i);
+    framemap_unindex(frame_number);
+    buddy_free(frame_number);
+}
 
 void prog_mem_free(Program *p) {
-    pthread_mutex_lock(&shellmemory_lock);
+    trace_lock(&shellmemory_lock, "shellmemory_lock");
+    prog_mem_free_unlocked(p);
+    pthread_mutex_unlock(&shellmemory_lock);
+}
+
+void prog_mem_free_unlocked(Program *p) {
     int num_of_pages = program_get_num_of_frames(p);
     for (int i = 0; i<num_of_pages; i++) {
         int frame = program_get_frame(p, i);
-        mem_free_frame(frame*FRAME_SIZE);
+        if (frame == -1) continue;
+        if (framemap_remove(frame, p, i) == 0) {  // still in use by programs sharing it otherwise
+            mem_free_frame(frame*frame_size);
+        }
     } 
-    pthread_mutex_unlock(&shellmemory_lock);
 } 
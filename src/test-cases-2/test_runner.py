@@ -1,11 +1,17 @@
 #!/usr/bin/env python3
 import argparse
 import os
+import pty
 import re
 import glob
+import select
+import shlex
 import shutil
 import subprocess
 import sys
+import tempfile
+import termios
+import time
 import difflib
 from collections import Counter
 from pathlib import Path
@@ -19,6 +25,18 @@ TEST_GLOB = "T_*.txt"
 TIMEOUT_SEC = 10
 MT_RUNS = 20                 # how many times to run MT tests
 
+# T_PTY* tests are typed into a pseudo-terminal one line at a time, each once the shell's output
+# has been quiet for PTY_QUIET_SEC, so scripts exec'd at the prompt run while the shell waits
+PTY_QUIET_SEC = 0.3
+
+# Optional files next to T_name.txt, for tests of features that are off by default:
+#   T_name.args   extra flags for the shell on one line, $TEST_TMP is expanded
+#   T_name.env    NAME=value lines added to the shell's environment, $TEST_TMP is expanded
+#   T_name.setup  sh script run in this folder before the shell starts
+#   T_name.check  sh script fed the shell's output on stdin, what it prints is compared to the
+#                 result files instead, so it can drop timing-dependent text or report on files left
+# Both scripts run with TEST_TMP (an empty folder, removed after each run) and MYSH in the environment.
+
 # If your grading ignores whitespace/capitalization, set these to True
 NORMALIZE_WHITESPACE = False   # if True: collapse whitespace runs to single spaces, strip lines
 IGNORE_CASE = False            # if True: compare lowercased output
@@ -62,6 +80,9 @@ def normalize_text(s: str) -> str:
 def is_mt_test(test_file: Path) -> bool:
     return test_file.stem.startswith("T_MT")
 
+def is_pty_test(test_file: Path) -> bool:
+    return test_file.stem.startswith("T_PTY")
+
 def text_line_counter(s: str) -> Counter:
     # MT tests are nondeterministic in ordering, so compare line multiplicities.
     return Counter(normalize_text(s).splitlines())
@@ -89,6 +110,44 @@ def summarize_counter_diff(expected: Counter, actual: Counter, max_items=20) ->
 def read_file_text(path: Path) -> str:
     return path.read_text(errors="replace")
 
+def sidecar(test_file: Path, suffix: str):
+    path = test_file.with_suffix(suffix)
+    return path if path.is_file() else None
+
+def test_args(test_file: Path, tmp: str):
+    path = sidecar(test_file, ".args")
+    if path is None:
+        return []
+    return shlex.split(read_file_text(path).replace("$TEST_TMP", tmp))
+
+def test_env(test_file: Path, tmp: str):
+    path = sidecar(test_file, ".env")
+    env = dict(os.environ)
+    if path is not None:
+        for line in read_file_text(path).splitlines():
+            if "=" in line:
+                name, value = line.split("=", 1)
+                env[name.strip()] = value.strip().replace("$TEST_TMP", tmp)
+    return env
+
+def run_script(script: Path, mysh: Path, tmp: str, stdin_text: str = ""):
+    # Returns (returncode, stdout, stderr, problem) like run_test
+    try:
+        proc = subprocess.run(
+            ["sh", str(script)],
+            cwd=script.parent,
+            input=stdin_text.encode(),
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            timeout=TIMEOUT_SEC,
+            env={**os.environ, "TEST_TMP": tmp, "MYSH": str(mysh)},
+        )
+    except subprocess.TimeoutExpired:
+        return None, "", "", f"{script.name} TIMEOUT after {TIMEOUT_SEC}s"
+    err = proc.stderr.decode(errors="replace")
+    problem = None if proc.returncode == 0 else f"{script.name} exited with {proc.returncode}: {err.strip()[:200]}"
+    return proc.returncode, proc.stdout.decode(errors="replace"), err, problem
+
 def snapshot_files(root: Path):
     # Snapshot regular files only (relative paths)
     files = set()
@@ -130,14 +189,15 @@ def cleanup_new_files(root: Path, before_set, after_set):
                     pass
     return deleted
 
-def run_test(mysh: Path, test_file: Path):
+def run_test(mysh: Path, test_file: Path, args, env):
     # Run: ../mysh < T_xxx.txt
     # We'll feed the test file as stdin to avoid shell redirection
     try:
         with test_file.open("rb") as f:
             proc = subprocess.run(
-                [str(mysh)],
+                [str(mysh), *args],
                 stdin=f,
+                env=env,
                 stdout=subprocess.PIPE,
                 stderr=subprocess.PIPE,
                 timeout=TIMEOUT_SEC,
@@ -150,6 +210,70 @@ def run_test(mysh: Path, test_file: Path):
     except FileNotFoundError:
         return None, "", "", f"Could not find executable: {mysh}"
 
+def run_pty_test(mysh: Path, test_file: Path, args, env):
+    master, slave = pty.openpty()
+    attrs = termios.tcgetattr(slave)
+    attrs[1] &= ~termios.OPOST  # no \r added before each \n
+    attrs[3] &= ~termios.ECHO   # only the shell's own output, not the typed lines
+    termios.tcsetattr(slave, termios.TCSANOW, attrs)
+    try:
+        proc = subprocess.Popen(
+            [str(mysh), *args],
+            stdin=slave,
+            stdout=slave,
+            stderr=subprocess.PIPE,
+            env=env,
+        )
+    except FileNotFoundError:
+        os.close(master)
+        os.close(slave)
+        return None, "", "", f"Could not find executable: {mysh}"
+    os.close(slave)
+
+    out = bytearray()
+    deadline = time.monotonic() + TIMEOUT_SEC
+
+    def read_output(quiet_sec):
+        # False once the shell closed the terminal
+        while time.monotonic() < deadline:
+            ready, _, _ = select.select([master], [], [], quiet_sec)
+            if not ready:
+                return True
+            try:
+                data = os.read(master, 4096)
+            except OSError:  # EIO once every slave descriptor is closed
+                return False
+            if not data:
+                return False
+            out.extend(data)
+        return True
+
+    open_terminal = True
+    for line in test_file.read_bytes().splitlines():
+        open_terminal = read_output(PTY_QUIET_SEC)
+        if not open_terminal:
+            break
+        os.write(master, line + b"\n")
+    if open_terminal and read_output(PTY_QUIET_SEC):
+        try:
+            os.write(master, b"\x04")  # end of input, like the end of the file in batch mode
+        except OSError:
+            pass
+        while read_output(0.1) and proc.poll() is None and time.monotonic() < deadline:
+            pass
+
+    problem = None
+    try:
+        proc.wait(timeout=max(deadline - time.monotonic(), 0.1))
+    except subprocess.TimeoutExpired:
+        proc.kill()
+        proc.wait()
+        problem = f"TIMEOUT after {TIMEOUT_SEC}s"
+    err = proc.stderr.read().decode(errors="replace")
+    proc.stderr.close()
+    os.close(master)
+    return proc.returncode, out.decode(errors="replace"), err, problem
+
 def find_expected_files(test_file: Path):
     # Supports:
     # T_name_result.txt
@@ -260,7 +384,25 @@ def main():
 
         for run_idx in range(1, runs + 1):
             before = snapshot_files(root) if CLEANUP_NEW_FILES else None
-            rc, out, err, run_problem = run_test(mysh, test_file)
+            tmp = tempfile.mkdtemp(prefix=f"{test_file.stem}_")
+            try:
+                rc, out, err, run_problem = None, "", "", None
+                setup = sidecar(test_file, ".setup")
+                if setup is not None:
+                    _, _, _, run_problem = run_script(setup, mysh, tmp)
+                if run_problem is None:
+                    args = test_args(test_file, tmp)
+                    env = test_env(test_file, tmp)
+                    if is_pty_test(test_file):
+                        rc, out, err, run_problem = run_pty_test(mysh, test_file, args, env)
+                    else:
+                        rc, out, err, run_problem = run_test(mysh, test_file, args, env)
+                check = sidecar(test_file, ".check")
+                if run_problem is None and check is not None:
+                    _, out, check_err, run_problem = run_script(check, mysh, tmp, out)
+                    err += check_err
+            finally:
+                shutil.rmtree(tmp, ignore_errors=True)
             after = snapshot_files(root) if CLEANUP_NEW_FILES else None
             deleted = cleanup_new_files(root, before, after) if CLEANUP_NEW_FILES else []
             total_deleted += len(deleted)
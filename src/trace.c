@@ -0,0 +1,250 @@
+#include "trace.h"
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Chrome trace-event JSON, for chrome://tracing or ui.perfetto.dev. Each thread appends its events
+// to a ring of its own without taking a lock and a flusher thread writes them out every
+// TRACE_FLUSH_MS. A full ring drops the event instead of waiting, the count goes in otherData.
+
+typedef struct TraceEvent {
+    const char *name;      // string literals, only the pointers are copied
+    const char *category;
+    const char *arg_name;  // NULL for none
+    char phase;            // 'X' span, 'i' instant, 'M' thread name
+    long start;            // ns since trace_init
+    long duration;
+    int pcb;               // -1 when the event isn't about a PCB
+    long arg;
+    char program[TRACE_NAME_LENGTH];  // copied, the program may be gone once it's written, the thread name for 'M'
+} TraceEvent;
+
+typedef struct TraceRing {  // single producer (its thread), single consumer (the flusher)
+    TraceEvent events[TRACE_RING_SIZE];
+    unsigned long head;  // atomic, written by the owner
+    unsigned long tail;  // atomic, written by the flusher
+    int tid;
+    int exited;  // atomic, the owner is gone and the ring is reused once the flusher emptied it
+    int in_use;
+    struct TraceRing *next;
+} TraceRing;
+
+int tracing = 0;
+static FILE *trace_out = NULL;
+static long trace_start_ns = 0;
+static pid_t trace_pid;
+static TraceRing *rings = NULL;  // every ring made so far, in_use and the list under ring_lock
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;  // a leaf, only thread registration and the flusher take it
+static pthread_key_t ring_key;   // its destructor marks the ring of an exiting thread
+static __thread TraceRing *own_ring = NULL;
+static int next_tid = 1;
+static unsigned long dropped = 0;  // atomic
+static int events_written = 0;     // whoever drains, there is only one at a time
+static pthread_t flusher;
+static int flusher_stop = 0;
+static pthread_mutex_t flusher_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flusher_wake = PTHREAD_COND_INITIALIZER;
+
+static long monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+long trace_now() {
+    if (!tracing) return 0;
+    return monotonic_ns() - trace_start_ns;
+}
+
+static void push(TraceRing *ring, const TraceEvent *event) {
+    unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == TRACE_RING_SIZE) {
+        __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    ring->events[head % TRACE_RING_SIZE] = *event;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void ring_exited(void *ring) {
+    __atomic_store_n(&((TraceRing *)ring)->exited, 1, __ATOMIC_RELEASE);
+}
+
+static TraceRing *thread_ring(const char *name) {  // registers the calling thread on its first event
+    if (own_ring != NULL) return own_ring;
+    pthread_mutex_lock(&ring_lock);
+    TraceRing *ring = rings;
+    while (ring != NULL && ring->in_use) {
+        ring = ring->next;
+    }
+    if (ring == NULL) {
+        ring = malloc(sizeof(TraceRing));
+        if (ring == NULL) {
+            pthread_mutex_unlock(&ring_lock);
+            return NULL;
+        }
+        ring->head = 0;
+        ring->tail = 0;
+        ring->next = rings;
+        rings = ring;
+    }
+    ring->in_use = 1;
+    __atomic_store_n(&ring->exited, 0, __ATOMIC_RELAXED);
+    ring->tid = next_tid++;
+    pthread_mutex_unlock(&ring_lock);
+    own_ring = ring;
+    pthread_setspecific(ring_key, ring);
+
+    TraceEvent event = {.name = "thread_name", .category = "", .phase = 'M', .pcb = -1};
+    if (name != NULL) snprintf(event.program, sizeof(event.program), "%s", name);
+    else snprintf(event.program, sizeof(event.program), "thread %d", ring->tid);
+    push(ring, &event);
+    return ring;
+}
+
+static void write_string(const char *string) {
+    fputc('"', trace_out);
+    for (; *string != '\0'; string++) {
+        if (*string == '"' || *string == '\\') fputc('\\', trace_out);
+        if ((unsigned char)*string >= 0x20) fputc(*string, trace_out);
+    }
+    fputc('"', trace_out);
+}
+
+static void write_event(int tid, const TraceEvent *event) {
+    fprintf(trace_out, "%s\n{\"name\":", (events_written++ == 0) ? "" : ",");
+    write_string(event->name);
+    fprintf(trace_out, ",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d", event->phase, (int)trace_pid, tid);
+    if (event->phase == 'M') {
+        fprintf(trace_out, ",\"args\":{\"name\":");
+        write_string(event->program);
+        fprintf(trace_out, "}}");
+        return;
+    }
+    fprintf(trace_out, ",\"cat\":");
+    write_string(event->category);
+    fprintf(trace_out, ",\"ts\":%.3f", event->start / 1000.0);
+    if (event->phase == 'X') fprintf(trace_out, ",\"dur\":%.3f", event->duration / 1000.0);
+    else fprintf(trace_out, ",\"s\":\"t\"");
+    fprintf(trace_out, ",\"args\":{");
+    const char *separator = "";
+    if (event->pcb >= 0) {
+        fprintf(trace_out, "\"pcb\":%d", event->pcb);
+        separator = ",";
+    }
+    if (event->program[0] != '\0') {
+        fprintf(trace_out, "%s\"program\":", separator);
+        write_string(event->program);
+        separator = ",";
+    }
+    if (event->arg_name != NULL) {
+        fprintf(trace_out, "%s", separator);
+        write_string(event->arg_name);
+        fprintf(trace_out, ":%ld", event->arg);
+    }
+    fprintf(trace_out, "}}");
+}
+
+static void drain() {  // the flusher, or the exiting thread once the flusher stopped
+    pthread_mutex_lock(&ring_lock);
+    for (TraceRing *ring = rings; ring != NULL; ring = ring->next) {
+        int exited = __atomic_load_n(&ring->exited, __ATOMIC_ACQUIRE);  // before head, so no push comes after
+        unsigned long tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for (; tail != head; tail++) {
+            write_event(ring->tid, &ring->events[tail % TRACE_RING_SIZE]);
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        if (exited) ring->in_use = 0;
+    }
+    pthread_mutex_unlock(&ring_lock);
+    fflush(trace_out);
+}
+
+static void *flush_loop(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&flusher_lock);
+    while (!flusher_stop) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += TRACE_FLUSH_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&flusher_wake, &flusher_lock, &until);
+        pthread_mutex_unlock(&flusher_lock);
+        drain();
+        pthread_mutex_lock(&flusher_lock);
+    }
+    pthread_mutex_unlock(&flusher_lock);
+    return NULL;
+}
+
+static void trace_shutdown() {
+    if (!tracing || getpid() != trace_pid) return;  // a run child that couldn't exec exits through here too
+    pthread_mutex_lock(&flusher_lock);
+    flusher_stop = 1;
+    pthread_cond_signal(&flusher_wake);
+    pthread_mutex_unlock(&flusher_lock);
+    pthread_join(flusher, NULL);
+    drain();
+    fprintf(trace_out, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":%lu}}\n",
+            __atomic_load_n(&dropped, __ATOMIC_RELAXED));
+    fclose(trace_out);
+}
+
+int trace_init(const char *path) {
+    trace_out = fopen(path, "w");
+    if (trace_out == NULL) {
+        printf("Couldn't open trace file %s\n", path);
+        return 1;
+    }
+    fprintf(trace_out, "{\"traceEvents\":[");
+    trace_start_ns = monotonic_ns();
+    trace_pid = getpid();
+    if (pthread_key_create(&ring_key, ring_exited) || pthread_create(&flusher, NULL, flush_loop, NULL)) {
+        printf("Couldn't start tracing\n");
+        fclose(trace_out);
+        return 1;
+    }
+    tracing = 1;
+    atexit(trace_shutdown);
+    return 0;
+}
+
+void trace_register_thread(const char *name) {
+    if (tracing) thread_ring(name);
+}
+
+void trace_span(const char *name, const char *category, long start, int pcb, const char *program, const char *arg_name, long arg) {
+    if (!tracing) return;
+    TraceRing *ring = thread_ring(NULL);
+    if (ring == NULL) return;
+    TraceEvent event = {.name = name, .category = category, .arg_name = arg_name, .phase = 'X', .start = start,
+                        .duration = trace_now() - start, .pcb = pcb, .arg = arg};
+    if (program != NULL) snprintf(event.program, sizeof(event.program), "%s", program);
+    push(ring, &event);
+}
+
+void trace_instant(const char *name, const char *category, int pcb, const char *program, const char *arg_name, long arg) {
+    if (!tracing) return;
+    TraceRing *ring = thread_ring(NULL);
+    if (ring == NULL) return;
+    TraceEvent event = {.name = name, .category = category, .arg_name = arg_name, .phase = 'i', .start = trace_now(),
+                        .pcb = pcb, .arg = arg};
+    if (program != NULL) snprintf(event.program, sizeof(event.program), "%s", program);
+    push(ring, &event);
+}
+
+// Takes lock, recording how long the thread waited for it when it was contended
+void trace_lock(pthread_mutex_t *lock, const char *name) {
+    if (!tracing) {
+        pthread_mutex_lock(lock);
+        return;
+    }
+    if (pthread_mutex_trylock(lock) == 0) return;
+    long start = trace_now();
+    pthread_mutex_lock(lock);
+    trace_span(name, "lock", start, -1, NULL, NULL, 0);
+}
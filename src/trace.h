@@ -0,0 +1,13 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <pthread.h>
+
+extern int tracing;  // set once by trace_init, before any worker starts
+
+int trace_init(const char *path);
+void trace_register_thread(const char *name);
+long trace_now();
+void trace_span(const char *name, const char *category, long start, int pcb, const char *program, const char *arg_name, long arg);
+void trace_instant(const char *name, const char *category, int pcb, const char *program, const char *arg_name, long arg);
+void trace_lock(pthread_mutex_t *lock, const char *name);
+#endif